@@ -8,19 +8,44 @@
 #define AUDIO_INIT_ADDR      (AUDIO_ADDR + 0x10)
 #define AUDIO_COUNT_ADDR     (AUDIO_ADDR + 0x14)
 
+// sbuf is a ring, samples are copied after the bytes committed before,
+// then committed by writing their number to AUDIO_COUNT_ADDR
+static uint32_t wpos = 0;
+
 void __am_audio_init() {
 }
 
 void __am_audio_config(AM_AUDIO_CONFIG_T *cfg) {
-  cfg->present = false;
+  cfg->present = true;
+  cfg->bufsize = inl(AUDIO_SBUF_SIZE_ADDR);
 }
 
 void __am_audio_ctrl(AM_AUDIO_CTRL_T *ctrl) {
+  outl(AUDIO_FREQ_ADDR, ctrl->freq);
+  outl(AUDIO_CHANNELS_ADDR, ctrl->channels);
+  outl(AUDIO_SAMPLES_ADDR, ctrl->samples);
+  outl(AUDIO_INIT_ADDR, 1);
+  wpos = 0;
 }
 
 void __am_audio_status(AM_AUDIO_STATUS_T *stat) {
-  stat->count = 0;
+  stat->count = inl(AUDIO_COUNT_ADDR);
 }
 
 void __am_audio_play(AM_AUDIO_PLAY_T *ctl) {
+  uint8_t *p = ctl->buf.start;
+  uint32_t len = ctl->buf.end - ctl->buf.start;
+  uint32_t size = inl(AUDIO_SBUF_SIZE_ADDR);
+  while (len > 0) {
+    uint32_t n = size - inl(AUDIO_COUNT_ADDR);
+    if (n == 0) continue;
+    if (n > len) n = len;
+    for (uint32_t i = 0; i < n; i ++) {
+      outb(AUDIO_SBUF_ADDR + wpos, p[i]);
+      wpos = (wpos + 1 == size ? 0 : wpos + 1);
+    }
+    outl(AUDIO_COUNT_ADDR, n);
+    p += n;
+    len -= n;
+  }
 }
@@ -53,6 +53,18 @@ __multi3 (DWtype u, DWtype v)
   UWtype w_high_tmp2x;
   UWtype carry;
 
+  /* Both operands fit in half a word, and so does the product.  */
+  if ((uu.s.high | vv.s.high | ((u_low | v_low) >> (W_TYPE_SIZE / 2))) == 0)
+    return __muluw3 (u_low, v_low);
+
+  /* Loop over the smaller low word, which runs out of set bits first.  */
+  if (v_low > u_low)
+    {
+      UWtype t = u_low;
+      u_low = v_low;
+      v_low = t;
+    }
+
   /* Calculate low half part of u and v, and get a UDWtype result just like
      what __umulsidi3 do.  */
   do
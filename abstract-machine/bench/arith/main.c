@@ -0,0 +1,98 @@
+#include <am.h>
+#include <klib.h>
+#include <klib-macros.h>
+
+// Integer arithmetic that ISAs without M leave to the libgcc helpers
+// (__mulsi3, __udivsi3, __muldi3, __udivdi3, ...). Every kernel walks the
+// same operand table, so the guest instructions spent in a kernel are the
+// instructions of the run with mainargs=<kernel> minus those of the run
+// with mainargs=none. See run.sh.
+
+#define NR_OPS 256
+#define ROUNDS 16
+
+static uint32_t a32[NR_OPS], b32[NR_OPS];
+static uint64_t a64[NR_OPS], b64[NR_OPS];
+
+static uint32_t seed = 1;
+static uint32_t next() {
+  seed = seed * 1103515245 + 12345;
+  return seed;
+}
+
+// operands of all widths, since the helpers exit early on small ones
+static void init() {
+  for (int i = 0; i < NR_OPS; i ++) {
+    a32[i] = next() >> (next() & 31);
+    b32[i] = (next() >> (next() & 31)) | 1;
+    a64[i] = (((uint64_t)next() << 32) | next()) >> (next() & 63);
+    b64[i] = ((((uint64_t)next() << 32) | next()) >> (next() & 63)) | 1;
+  }
+}
+
+static uint32_t k_none() {
+  return 0;
+}
+
+static uint32_t k_mul() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) sum += a32[i] * b32[i];
+  return sum;
+}
+
+static uint32_t k_div() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) sum += a32[i] / b32[i];
+  return sum;
+}
+
+static uint32_t k_mod() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) sum += a32[i] % b32[i];
+  return sum;
+}
+
+static uint32_t k_sdiv() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) {
+    int32_t a = (i & 1 ? -(int32_t)a32[i] : (int32_t)a32[i]);
+    sum += a / (int32_t)b32[i] + a % (int32_t)b32[i];
+  }
+  return sum;
+}
+
+static uint32_t k_mul64() {
+  uint64_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) sum += a64[i] * b64[i];
+  return sum ^ (sum >> 32);
+}
+
+static uint32_t k_div64() {
+  uint64_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) sum += a64[i] / b64[i] + a64[i] % b64[i];
+  return sum ^ (sum >> 32);
+}
+
+static struct {
+  const char *name;
+  uint32_t (*func)();
+} kernels[] = {
+  { "none",  k_none  },
+  { "mul",   k_mul   },
+  { "div",   k_div   },
+  { "mod",   k_mod   },
+  { "sdiv",  k_sdiv  },
+  { "mul64", k_mul64 },
+  { "div64", k_div64 },
+};
+
+int main(const char *args) {
+  init();
+  for (int i = 0; i < LENGTH(kernels); i ++) {
+    if (strcmp(args, kernels[i].name) != 0 && strcmp(args, "all") != 0) continue;
+    uint32_t sum = 0;
+    for (int r = 0; r < ROUNDS; r ++) sum += kernels[i].func();
+    printf("%s: checksum = 0x%08x\n", kernels[i].name, sum);
+  }
+  return 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/bash
+# Print the guest instructions spent in each kernel, counted by NEMU.
+# Run it before and after touching the libgcc helpers to compare them.
+#   usage: ./run.sh [ARCH]    (default: riscv32mini-nemu)
+
+ARCH=${1:-riscv32mini-nemu}
+cd $(dirname $0)
+LOG=$(pwd)/build/bench-log.txt
+
+count() {
+  make -s ARCH=$ARCH run mainargs=$1 NEMUFLAGS="-b -l $LOG" > /dev/null || exit 1
+  grep -o "total guest instructions = [0-9,]*" $LOG | grep -o "[0-9,]*$" | tr -d ,
+}
+
+base=$(count none)
+for k in mul div mod sdiv mul64 div64; do
+  printf "%-6s %12d\n" $k $(($(count $k) - base))
+done
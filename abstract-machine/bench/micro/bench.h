@@ -0,0 +1,27 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <am.h>
+#include <klib.h>
+#include <klib-macros.h>
+
+typedef struct {
+  const char *name;
+  void (*init)();
+  uint32_t (*run)(); // returns a checksum, so the work can not be dropped
+} Kernel;
+
+#define DECL_KERNEL(name) extern Kernel kernel_##name;
+#define DEF_KERNEL(name, init, run) Kernel kernel_##name = { #name, init, run };
+
+#define KERNELS(f) \
+  f(memcpy) f(memset) f(memmove) f(memcmp) \
+  f(strlen) f(strcmp) f(strcpy) \
+  f(malloc) f(printf) f(mix)
+
+KERNELS(DECL_KERNEL)
+
+uint32_t bench_rand();
+void bench_srand(uint32_t seed);
+
+#endif
@@ -0,0 +1,88 @@
+#include "bench.h"
+
+// Microbenchmarks of klib, the arithmetic left to libgcc is measured by
+// bench/arith. Every kernel reports the instructions and cycles it takes,
+// read from the riscv counters: NEMU counts one cycle per instruction,
+// while NPC reports the cycles of the RTL. Other ISAs only report the
+// time. run.sh collects the lines into a results file.
+//   mainargs: the name of a kernel, or empty/"all" for all of them
+
+#define ROUNDS 4
+
+static Kernel *kernels[] = {
+#define KERNEL_PTR(name) &kernel_##name,
+  KERNELS(KERNEL_PTR)
+};
+
+typedef struct {
+  uint64_t inst, cycle, us;
+} Counter;
+
+#if defined(__riscv)
+#define csr_read(csr) ({ uintptr_t __v; asm volatile ("csrr %0, " #csr : "=r"(__v)); __v; })
+
+#if __riscv_xlen == 32
+// read the high half twice, in case the low half wraps around in between
+#define counter_read(lo, hi) ({ \
+  uint32_t __h, __l; \
+  do { __h = csr_read(hi); __l = csr_read(lo); } while (__h != csr_read(hi)); \
+  ((uint64_t)__h << 32) | __l; \
+})
+#else
+#define counter_read(lo, hi) ((uint64_t)csr_read(lo))
+#endif
+
+static void counter_get(Counter *c) {
+  c->us    = io_read(AM_TIMER_UPTIME).us;
+  c->cycle = counter_read(0xb00, 0xb80); // mcycle
+  c->inst  = counter_read(0xb02, 0xb82); // minstret
+}
+#else
+static void counter_get(Counter *c) {
+  c->us = io_read(AM_TIMER_UPTIME).us;
+  c->cycle = c->inst = 0;
+}
+#endif
+
+static uint32_t seed = 1;
+
+uint32_t bench_rand() {
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+void bench_srand(uint32_t s) {
+  seed = s;
+}
+
+int main(const char *args) {
+  ioe_init();
+
+  bool all = (args == NULL || args[0] == '\0' || strcmp(args, "all") == 0);
+  int nr_run = 0;
+  for (int i = 0; i < LENGTH(kernels); i ++) {
+    Kernel *k = kernels[i];
+    if (!all && strcmp(args, k->name) != 0) continue;
+
+    bench_srand(i + 1);
+    if (k->init) k->init();
+
+    Counter start, end;
+    uint32_t sum = 0;
+    counter_get(&start);
+    for (int r = 0; r < ROUNDS; r ++) sum += k->run();
+    counter_get(&end);
+
+    // one line per kernel, parsed by run.sh
+    printf("micro: %s inst=%llu cycle=%llu us=%llu checksum=0x%08x\n", k->name,
+        (unsigned long long)(end.inst - start.inst), (unsigned long long)(end.cycle - start.cycle),
+        (unsigned long long)(end.us - start.us), sum);
+    nr_run ++;
+  }
+
+  if (nr_run == 0) {
+    printf("micro: unknown kernel '%s'\n", args);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,41 @@
+#include "bench.h"
+
+// malloc()/free() with a random mix of lifetimes and sizes, mostly small
+
+#define NR_SLOT 64
+#define NR_OPS  512
+
+static void *slot[NR_SLOT];
+static struct {
+  uint16_t idx, size;
+} ops[NR_OPS];
+
+static void init() {
+  for (int i = 0; i < NR_OPS; i ++) {
+    ops[i].idx = bench_rand() % NR_SLOT;
+    ops[i].size = (i % 8 == 0 ? bench_rand() % 4096 : bench_rand() % 128) + 1;
+  }
+}
+
+static uint32_t run() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) {
+    void **p = &slot[ops[i].idx];
+    if (*p != NULL) {
+      free(*p);
+      *p = NULL;
+    } else {
+      *p = malloc(ops[i].size);
+      if (*p == NULL) continue;
+      *(uint8_t *)*p = i;
+      sum += ops[i].size;
+    }
+  }
+  for (int i = 0; i < NR_SLOT; i ++) {
+    free(slot[i]);
+    slot[i] = NULL;
+  }
+  return sum;
+}
+
+DEF_KERNEL(malloc, init, run)
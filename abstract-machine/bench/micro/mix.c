@@ -0,0 +1,119 @@
+#include "bench.h"
+
+// A small CoreMark-like mix: list walking, a matrix product, a state
+// machine scanning text and a CRC over the results. It stands for the
+// branchy integer code of real programs, not for any klib routine.
+
+#define NR_NODE 64
+#define N       12
+#define TEXT_LEN 512
+
+typedef struct node {
+  struct node *next;
+  int16_t key, val;
+} Node;
+
+static Node pool[NR_NODE];
+static int16_t ma[N][N], mb[N][N];
+static int32_t mc[N][N];
+static char text[TEXT_LEN];
+
+static uint16_t crc16(uint16_t crc, uint32_t data, int bits) {
+  for (int i = 0; i < bits; i ++) {
+    int x = (data ^ crc) & 1;
+    data >>= 1;
+    crc = (x ? (crc >> 1) ^ 0xa001 : crc >> 1);
+  }
+  return crc;
+}
+
+static Node *list_build() {
+  Node *head = NULL;
+  for (int i = 0; i < NR_NODE; i ++) {
+    Node **p = &head;
+    while (*p != NULL && (*p)->key < pool[i].key) p = &(*p)->next;
+    pool[i].next = *p;
+    *p = &pool[i];
+  }
+  return head;
+}
+
+static Node *list_reverse(Node *head) {
+  Node *prev = NULL;
+  while (head != NULL) {
+    Node *next = head->next;
+    head->next = prev;
+    prev = head;
+    head = next;
+  }
+  return prev;
+}
+
+static uint16_t run_list(uint16_t crc) {
+  Node *head = list_build();
+  for (int k = 0; k < 16; k ++) {
+    Node *p = head;
+    while (p != NULL && p->key != pool[k * 3].key) p = p->next;
+    crc = crc16(crc, p ? p->val : 0xffff, 16);
+  }
+  head = list_reverse(head);
+  for (Node *p = head; p != NULL; p = p->next) crc = crc16(crc, p->key, 8);
+  return crc;
+}
+
+static uint16_t run_matrix(uint16_t crc) {
+  for (int i = 0; i < N; i ++) {
+    for (int j = 0; j < N; j ++) {
+      int32_t s = 0;
+      for (int k = 0; k < N; k ++) s += ma[i][k] * mb[k][j];
+      mc[i][j] = s;
+    }
+  }
+  for (int i = 0; i < N; i ++) crc = crc16(crc, mc[i][i], 32);
+  return crc;
+}
+
+// count the integers, floats and bad tokens in the text
+static uint16_t run_state(uint16_t crc) {
+  enum { START, INT, FLOAT, EXP, BAD } s = START;
+  int count[5] = { 0 };
+  for (int i = 0; i < TEXT_LEN; i ++) {
+    char c = text[i];
+    bool digit = (c >= '0' && c <= '9');
+    if (c == ',') { count[s] ++; s = START; continue; }
+    switch (s) {
+      case START: s = (digit || c == '-' ? INT : c == '.' ? FLOAT : BAD); break;
+      case INT:   s = (digit ? INT : c == '.' ? FLOAT : c == 'e' ? EXP : BAD); break;
+      case FLOAT: s = (digit ? FLOAT : c == 'e' ? EXP : BAD); break;
+      case EXP:   s = (digit || c == '-' ? EXP : BAD); break;
+      default: break;
+    }
+  }
+  for (int i = 0; i < 5; i ++) crc = crc16(crc, count[i], 16);
+  return crc;
+}
+
+static void init() {
+  for (int i = 0; i < NR_NODE; i ++) {
+    pool[i].key = bench_rand() % 1024;
+    pool[i].val = bench_rand();
+  }
+  for (int i = 0; i < N; i ++) {
+    for (int j = 0; j < N; j ++) {
+      ma[i][j] = bench_rand() % 512 - 256;
+      mb[i][j] = bench_rand() % 512 - 256;
+    }
+  }
+  static const char chars[] = "0123456789.-e,,x";
+  for (int i = 0; i < TEXT_LEN; i ++) text[i] = chars[bench_rand() % 16];
+}
+
+static uint32_t run() {
+  uint16_t crc = 0;
+  crc = run_list(crc);
+  crc = run_matrix(crc);
+  crc = run_state(crc);
+  return crc;
+}
+
+DEF_KERNEL(mix, init, run)
@@ -0,0 +1,31 @@
+#include "bench.h"
+
+// formatting into a buffer, so the console does not count
+
+#define NR_OPS 64
+
+static int32_t ival[NR_OPS];
+static uint64_t lval[NR_OPS];
+
+static void init() {
+  for (int i = 0; i < NR_OPS; i ++) {
+    ival[i] = bench_rand();
+    ival[i] >>= bench_rand() % 24;
+    if (i & 1) ival[i] = -ival[i];
+    lval[i] = (uint64_t)bench_rand() << 40;
+    lval[i] ^= bench_rand();
+  }
+}
+
+static uint32_t run() {
+  char buf[128];
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) {
+    sum += snprintf(buf, sizeof(buf), "%d %u %x", ival[i], (uint32_t)ival[i], ival[i]);
+    sum += snprintf(buf, sizeof(buf), "[%-8s] %08x %5d%%", "name", ival[i], i);
+    sum += snprintf(buf, sizeof(buf), "%llu %p", (unsigned long long)lval[i], (void *)(uintptr_t)ival[i]);
+  }
+  return sum;
+}
+
+DEF_KERNEL(printf, init, run)
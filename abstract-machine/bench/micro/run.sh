@@ -0,0 +1,21 @@
+#!/bin/bash
+# Run all the kernels and append one line per kernel to a CSV file, tagged
+# with the commit, so runs of different commits can be compared.
+#   usage: ./run.sh [ARCH] [RESULTS]
+#     (default: riscv32-nemu, build/results-$ARCH.csv)
+
+ARCH=${1:-riscv32-nemu}
+cd $(dirname $0)
+RESULTS=${2:-build/results-$ARCH.csv}
+OUT=build/micro-$ARCH.out
+
+mkdir -p build $(dirname $RESULTS)
+make -s ARCH=$ARCH run mainargs=all NEMUFLAGS="-b" > $OUT 2>&1 || { cat $OUT; exit 1; }
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+git diff --quiet HEAD -- $AM_HOME 2>/dev/null || commit=$commit-dirty
+test -s $RESULTS || echo "commit,arch,kernel,inst,cycle,us,checksum" > $RESULTS
+
+n=$(grep "^micro: [a-z0-9]* inst=" $OUT | sed -E "s/^micro: ([a-z0-9]+) inst=([0-9]+) cycle=([0-9]+) us=([0-9]+) checksum=(0x[0-9a-f]+).*/$commit,$ARCH,\1,\2,\3,\4,\5/" | tee -a $RESULTS | wc -l)
+test $n -gt 0 || { cat $OUT; exit 1; }
+tail -n $n $RESULTS | tr , "\t"
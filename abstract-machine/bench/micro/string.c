@@ -0,0 +1,105 @@
+#include "bench.h"
+
+// mem* and str* on a mix of short and long operands at all alignments,
+// the way the kernels and the libraries above klib call them
+
+#define BUF_SIZE 4096
+#define NR_OPS   128
+
+static uint8_t src[BUF_SIZE], dst[BUF_SIZE];
+static struct {
+  uint16_t so, dof, len;
+} ops[NR_OPS];
+
+// lengths are mostly short, with a long one now and then
+static void init_ops() {
+  for (int i = 0; i < NR_OPS; i ++) {
+    int len = (i % 16 == 0 ? 1024 + bench_rand() % 1024 : bench_rand() % 64 + 1);
+    ops[i].len = len;
+    ops[i].so  = bench_rand() % (BUF_SIZE / 2 - len);
+    ops[i].dof = bench_rand() % (BUF_SIZE / 2 - len);
+  }
+  for (int i = 0; i < BUF_SIZE; i ++) src[i] = bench_rand() % 255 + 1;
+}
+
+static uint32_t run_memcpy() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) {
+    memcpy(dst + ops[i].dof, src + ops[i].so, ops[i].len);
+    sum += dst[ops[i].dof + ops[i].len - 1];
+  }
+  return sum;
+}
+
+static uint32_t run_memset() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) {
+    memset(dst + ops[i].dof, i, ops[i].len);
+    sum += dst[ops[i].dof];
+  }
+  return sum;
+}
+
+// overlapping copies in both directions
+static uint32_t run_memmove() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) {
+    int d = ops[i].len / 2 + 1;
+    if (i & 1) memmove(dst + ops[i].dof + d, dst + ops[i].dof, ops[i].len);
+    else memmove(dst + ops[i].dof, dst + ops[i].dof + d, ops[i].len);
+    sum += dst[ops[i].dof];
+  }
+  return sum;
+}
+
+// equal buffers, so every byte is compared
+static void init_memcmp() {
+  init_ops();
+  memcpy(dst, src, BUF_SIZE);
+}
+
+static uint32_t run_memcmp() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) {
+    sum += memcmp(dst + ops[i].so, src + ops[i].so, ops[i].len) == 0;
+    sum += memcmp(dst + ops[i].so, src + ops[i].dof, ops[i].len) < 0;
+  }
+  return sum;
+}
+
+// cut src into strings ending at each operand
+static void init_str() {
+  init_ops();
+  for (int i = 0; i < NR_OPS; i ++) src[ops[i].so + ops[i].len - 1] = '\0';
+  memcpy(dst, src, BUF_SIZE);
+}
+
+static uint32_t run_strlen() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) sum += strlen((char *)src + ops[i].so);
+  return sum;
+}
+
+static uint32_t run_strcmp() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) sum += strcmp((char *)src + ops[i].so, (char *)dst + ops[i].so) == 0;
+  return sum;
+}
+
+static uint32_t run_strcpy() {
+  uint32_t sum = 0;
+  for (int i = 0; i < NR_OPS; i ++) {
+    char *d = (char *)dst + BUF_SIZE / 2 + ops[i].dof;
+    strcpy(d, (char *)src + ops[i].so);
+    sum += d[0];
+  }
+  return sum;
+}
+
+DEF_KERNEL(memcpy,  init_ops,    run_memcpy)
+DEF_KERNEL(memset,  init_ops,    run_memset)
+DEF_KERNEL(memmove, init_ops,    run_memmove)
+DEF_KERNEL(memcmp,  init_memcmp, run_memcmp)
+DEF_KERNEL(strlen,  init_str,    run_strlen)
+DEF_KERNEL(strcmp,  init_str,    run_strcmp)
+DEF_KERNEL(strcpy,  init_str,    run_strcpy)
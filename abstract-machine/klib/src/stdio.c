@@ -5,24 +5,269 @@
 
 #if !defined(__ISA_NATIVE__) || defined(__NATIVE_USE_KLIB__)
 
+// All the functions below share one formatter, which walks the format
+// once and writes into a fixed buffer. For printf() the buffer lives on
+// the stack and is handed to putch() whenever it fills up; for the
+// string versions it is the caller's buffer and the characters beyond
+// its end are only counted.
+typedef struct {
+  char *buf;
+  size_t size;  // room in buf
+  size_t pos;   // next character goes to buf[pos]
+  size_t len;   // characters produced so far
+  bool console; // flush buf to putch() instead of dropping characters
+} Out;
+
+static void out_flush(Out *o) {
+  for (size_t i = 0; i < o->pos; i ++) putch(o->buf[i]);
+  o->pos = 0;
+}
+
+static inline void out_char(Out *o, char c) {
+  o->len ++;
+  if (o->pos == o->size) {
+    if (!o->console) return;
+    out_flush(o);
+  }
+  o->buf[o->pos ++] = c;
+}
+
+static void out_str(Out *o, const char *s, size_t n) {
+  for (size_t i = 0; i < n; i ++) out_char(o, s[i]);
+}
+
+static void out_pad(Out *o, char c, int n) {
+  for (; n > 0; n --) out_char(o, c);
+}
+
+// Decimal conversion emits two digits per division, which matters on
+// ISAs without a divider, where every division is a libgcc call.
+#define PAIRS(d) #d "0" #d "1" #d "2" #d "3" #d "4" #d "5" #d "6" #d "7" #d "8" #d "9"
+static const char digit_pairs[200] = PAIRS(0) PAIRS(1) PAIRS(2) PAIRS(3) PAIRS(4)
+                                     PAIRS(5) PAIRS(6) PAIRS(7) PAIRS(8) PAIRS(9);
+static const char xdigits[2][16] = { "0123456789abcdef", "0123456789ABCDEF" };
+
+// write the digits of @v backwards, ending before @p
+static char *fmt_dec(char *p, unsigned long v) {
+  for (; v >= 100; v /= 100) {
+    const char *d = &digit_pairs[(v % 100) * 2];
+    *-- p = d[1];
+    *-- p = d[0];
+  }
+  if (v >= 10) {
+    *-- p = digit_pairs[v * 2 + 1];
+    *-- p = digit_pairs[v * 2];
+  } else {
+    *-- p = '0' + v;
+  }
+  return p;
+}
+
+static char *fmt_dec64(char *p, unsigned long long v) {
+  // When long is 32-bit, a 64-bit division is a long software routine
+  // anyway. Peel off 9 digits at a time with a shift-and-subtract loop.
+  while (v > (unsigned long)-1) {
+    unsigned long r = 0;
+    for (int i = 0; i < 64; i ++) {
+      r = (r << 1) | (unsigned long)(v >> 63);
+      v <<= 1;
+      if (r >= 1000000000) { r -= 1000000000; v |= 1; }
+    }
+    char *low = p - 9;
+    for (p = fmt_dec(p, r); p > low; ) *-- p = '0';
+  }
+  return fmt_dec(p, v);
+}
+
+static char *fmt_base(char *p, unsigned long long v, int shift, bool upper) {
+  do {
+    *-- p = xdigits[upper][v & ((1 << shift) - 1)];
+    v >>= shift;
+  } while (v != 0);
+  return p;
+}
+
+enum { F_LEFT = 1, F_PLUS = 2, F_SPACE = 4, F_ALT = 8, F_ZERO = 16 };
+
+static void out_num(Out *o, unsigned long long v, bool neg, char conv,
+    int flags, int width, int prec) {
+  char tmp[24], *end = tmp + sizeof(tmp), *p = end;
+  char prefix[2];
+  int npre = 0;
+
+  if (!(prec == 0 && v == 0)) {
+    switch (conv) {
+      case 'o': p = fmt_base(p, v, 3, false); break;
+      case 'x': p = fmt_base(p, v, 4, false); break;
+      case 'X': p = fmt_base(p, v, 4, true); break;
+      default:  p = fmt_dec64(p, v); break;
+    }
+  }
+  int ndig = end - p;
+
+  if (neg) prefix[npre ++] = '-';
+  else if ((conv == 'd' || conv == 'i') && (flags & F_PLUS)) prefix[npre ++] = '+';
+  else if ((conv == 'd' || conv == 'i') && (flags & F_SPACE)) prefix[npre ++] = ' ';
+  else if ((flags & F_ALT) && (conv == 'x' || conv == 'X') && v != 0) {
+    prefix[npre ++] = '0';
+    prefix[npre ++] = conv;
+  }
+
+  int nzero = (prec > ndig ? prec - ndig : 0);
+  // the alternate form of octal starts with 0, which is not a precision,
+  // so it does not turn off the zero padding of the width
+  if ((flags & F_ALT) && conv == 'o' && nzero == 0 && (ndig == 0 || *p != '0')) nzero = 1;
+  int npad = width - npre - nzero - ndig;
+  if ((flags & F_ZERO) && !(flags & F_LEFT) && prec < 0 && npad > 0) {
+    nzero += npad;
+    npad = 0;
+  }
+
+  if (!(flags & F_LEFT)) out_pad(o, ' ', npad);
+  out_str(o, prefix, npre);
+  out_pad(o, '0', nzero);
+  out_str(o, p, ndig);
+  if (flags & F_LEFT) out_pad(o, ' ', npad);
+}
+
+static void vformat(Out *o, const char *fmt, va_list ap) {
+  for (; *fmt != '\0'; fmt ++) {
+    if (*fmt != '%') { out_char(o, *fmt); continue; }
+    const char *spec = fmt ++;
+
+    int flags = 0;
+    for (;; fmt ++) {
+      if      (*fmt == '-') flags |= F_LEFT;
+      else if (*fmt == '+') flags |= F_PLUS;
+      else if (*fmt == ' ') flags |= F_SPACE;
+      else if (*fmt == '#') flags |= F_ALT;
+      else if (*fmt == '0') flags |= F_ZERO;
+      else break;
+    }
+
+    int width = 0;
+    if (*fmt == '*') {
+      width = va_arg(ap, int);
+      if (width < 0) { flags |= F_LEFT; width = -width; }
+      fmt ++;
+    } else {
+      for (; *fmt >= '0' && *fmt <= '9'; fmt ++) width = width * 10 + *fmt - '0';
+    }
+
+    int prec = -1;
+    if (*fmt == '.') {
+      fmt ++;
+      if (*fmt == '*') {
+        prec = va_arg(ap, int);
+        if (prec < 0) prec = -1;
+        fmt ++;
+      } else {
+        for (prec = 0; *fmt >= '0' && *fmt <= '9'; fmt ++) prec = prec * 10 + *fmt - '0';
+      }
+    }
+
+    // 'H' and 'L' stand for hh and ll
+    char len = 0;
+    switch (*fmt) {
+      case 'h': len = 'h'; if (*++ fmt == 'h') { len = 'H'; fmt ++; } break;
+      case 'l': len = 'l'; if (*++ fmt == 'l') { len = 'L'; fmt ++; } break;
+      case 'z': case 'j': case 't': len = *fmt ++; break;
+    }
+
+    unsigned long long v;
+    switch (*fmt) {
+      case 'd': case 'i': {
+        long long x;
+        switch (len) {
+          case 'H': x = (signed char)va_arg(ap, int); break;
+          case 'h': x = (short)va_arg(ap, int); break;
+          case 'l': x = va_arg(ap, long); break;
+          case 'L': case 'j': x = va_arg(ap, long long); break;
+          case 'z': case 't': x = va_arg(ap, ptrdiff_t); break;
+          default:  x = va_arg(ap, int); break;
+        }
+        v = (x < 0 ? 0ull - (unsigned long long)x : (unsigned long long)x);
+        out_num(o, v, x < 0, *fmt, flags, width, prec);
+        break;
+      }
+      case 'u': case 'x': case 'X': case 'o':
+        switch (len) {
+          case 'H': v = (unsigned char)va_arg(ap, unsigned); break;
+          case 'h': v = (unsigned short)va_arg(ap, unsigned); break;
+          case 'l': v = va_arg(ap, unsigned long); break;
+          case 'L': case 'j': v = va_arg(ap, unsigned long long); break;
+          case 'z': case 't': v = va_arg(ap, size_t); break;
+          default:  v = va_arg(ap, unsigned); break;
+        }
+        out_num(o, v, false, *fmt, flags, width, prec);
+        break;
+      case 'p':
+        v = (uintptr_t)va_arg(ap, void *);
+        out_num(o, v, false, 'x', flags | F_ALT, width, prec);
+        break;
+      case 'c':
+        if (!(flags & F_LEFT)) out_pad(o, ' ', width - 1);
+        out_char(o, (char)va_arg(ap, int));
+        if (flags & F_LEFT) out_pad(o, ' ', width - 1);
+        break;
+      case 's': {
+        const char *s = va_arg(ap, const char *);
+        if (s == NULL) s = "(null)";
+        int n = 0;
+        while ((prec < 0 || n < prec) && s[n] != '\0') n ++;
+        if (!(flags & F_LEFT)) out_pad(o, ' ', width - n);
+        out_str(o, s, n);
+        if (flags & F_LEFT) out_pad(o, ' ', width - n);
+        break;
+      }
+      case '%': out_char(o, '%'); break;
+      default:
+        // unknown conversion, print it as is
+        out_str(o, spec, fmt - spec);
+        if (*fmt == '\0') return;
+        out_char(o, *fmt);
+        break;
+    }
+  }
+}
+
 int printf(const char *fmt, ...) {
-  panic("Not implemented");
+  char buf[128];
+  Out o = { .buf = buf, .size = sizeof(buf), .console = true };
+  va_list ap;
+  va_start(ap, fmt);
+  vformat(&o, fmt, ap);
+  va_end(ap);
+  out_flush(&o);
+  return o.len;
 }
 
 int vsprintf(char *out, const char *fmt, va_list ap) {
-  panic("Not implemented");
+  return vsnprintf(out, (size_t)-1, fmt, ap);
 }
 
 int sprintf(char *out, const char *fmt, ...) {
-  panic("Not implemented");
+  va_list ap;
+  va_start(ap, fmt);
+  int ret = vsnprintf(out, (size_t)-1, fmt, ap);
+  va_end(ap);
+  return ret;
 }
 
 int snprintf(char *out, size_t n, const char *fmt, ...) {
-  panic("Not implemented");
+  va_list ap;
+  va_start(ap, fmt);
+  int ret = vsnprintf(out, n, fmt, ap);
+  va_end(ap);
+  return ret;
 }
 
 int vsnprintf(char *out, size_t n, const char *fmt, va_list ap) {
-  panic("Not implemented");
+  // keep the last byte for the terminator
+  Out o = { .buf = out, .size = (n > 0 ? n - 1 : 0), .console = false };
+  vformat(&o, fmt, ap);
+  if (n > 0) out[o.pos] = '\0';
+  return o.len;
 }
 
 #endif
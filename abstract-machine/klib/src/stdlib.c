@@ -29,17 +29,248 @@ int atoi(const char* nptr) {
   return x;
 }
 
+// malloc() carves chunks out of the heap with a bump pointer, the top
+// chunk. A chunk starts with the size of the chunk below (valid only when
+// that one is free) and its own size with two flag bits; the payload of
+// an allocated chunk runs into the first word of the next chunk. Free
+// chunks are linked into bins and merged with free neighbours, so both
+// malloc() and free() only touch a few chunks:
+//   - small bins hold one size each, found through a bitmap
+//   - large bins hold sizes in [2^i, 2^(i+1)) and are searched first-fit
+// With __KLIB_MALLOC_MPE__, the bins are guarded by a spinlock and every
+// CPU keeps a few freed small chunks of each size for itself.
+typedef struct chunk {
+  size_t prev_size;
+  size_t head;
+  struct chunk *next, *prev; // links of a free chunk, in the payload
+} chunk_t;
+
+#define INUSE      1
+#define PREV_INUSE 2
+#define FLAGS      (INUSE | PREV_INUSE)
+#define ALIGN      (2 * sizeof(size_t))
+#define MIN_CHUNK  sizeof(chunk_t)
+#define NR_SMALL   (8 * sizeof(uintptr_t))
+#define SMALL_MAX  (NR_SMALL * ALIGN)
+#define NR_LARGE   (8 * sizeof(uintptr_t))
+
+#define csize(p)         ((p)->head & ~(size_t)FLAGS)
+#define chunk_at(p, off) ((chunk_t *)((char *)(p) + (off)))
+#define chunk2mem(p)     ((void *)&(p)->next)
+#define mem2chunk(m)     ((chunk_t *)((char *)(m) - offsetof(chunk_t, next)))
+
+static chunk_t *top = NULL;
+static chunk_t small_bin[NR_SMALL], large_bin[NR_LARGE]; // list heads
+static uintptr_t small_map, large_map;
+
+// index of the lowest set bit, without the libgcc helpers
+static inline int low_bit(uintptr_t x) {
+  int i = 0;
+  for (int w = 4 * sizeof(x); w > 0; w >>= 1) {
+    if ((x & (((uintptr_t)1 << w) - 1)) == 0) { x >>= w; i += w; }
+  }
+  return i;
+}
+
+static inline int high_bit(uintptr_t x) {
+  int i = 0;
+  for (int w = 4 * sizeof(x); w > 0; w >>= 1) {
+    if (x >> w) { x >>= w; i += w; }
+  }
+  return i;
+}
+
+static inline chunk_t *bin_of(size_t sz) {
+  return sz < SMALL_MAX ? &small_bin[sz / ALIGN] : &large_bin[high_bit(sz)];
+}
+
+static void bin_insert(chunk_t *p) {
+  size_t sz = csize(p);
+  chunk_t *bin = bin_of(sz);
+  if (bin->next == NULL || bin->next == bin) {
+    bin->next = bin->prev = bin;
+    if (sz < SMALL_MAX) small_map |= (uintptr_t)1 << (sz / ALIGN);
+    else large_map |= (uintptr_t)1 << high_bit(sz);
+  }
+  p->next = bin->next;
+  p->prev = bin;
+  bin->next->prev = p;
+  bin->next = p;
+}
+
+static void bin_remove(chunk_t *p) {
+  p->prev->next = p->next;
+  p->next->prev = p->prev;
+  if (p->next == p->prev) { // the bin is empty now
+    size_t sz = csize(p);
+    if (sz < SMALL_MAX) small_map &= ~((uintptr_t)1 << (sz / ALIGN));
+    else large_map &= ~((uintptr_t)1 << high_bit(sz));
+  }
+}
+
+static chunk_t *bin_fit(size_t nb) {
+  if (nb < SMALL_MAX) {
+    uintptr_t map = small_map >> (nb / ALIGN);
+    if (map) return small_bin[nb / ALIGN + low_bit(map)].next;
+  }
+  int i = high_bit(nb);
+  if (large_map & ((uintptr_t)1 << i)) {
+    for (chunk_t *p = large_bin[i].next; p != &large_bin[i]; p = p->next) {
+      if (csize(p) >= nb) return p;
+    }
+  }
+  uintptr_t map = (i + 1 < NR_LARGE ? large_map >> (i + 1) : 0);
+  return map ? large_bin[i + 1 + low_bit(map)].next : NULL;
+}
+
+// mark @p free, fix up the chunk above and put @p into a bin
+static void set_free(chunk_t *p, size_t sz) {
+  p->head = sz | PREV_INUSE;
+  chunk_t *nxt = chunk_at(p, sz);
+  nxt->prev_size = sz;
+  nxt->head &= ~(size_t)PREV_INUSE;
+  bin_insert(p);
+}
+
+static bool heap_init() {
+  // on native, malloc() is called by the C runtime before the heap is ready
+  if (heap.start == NULL) return false;
+  uintptr_t start = ROUNDUP(heap.start, ALIGN);
+  uintptr_t end = ROUNDDOWN(heap.end, ALIGN);
+  top = (chunk_t *)start;
+  top->head = (end - start) | PREV_INUSE;
+  return true;
+}
+
+static void *do_malloc(size_t nb) {
+  chunk_t *p;
+  if (nb < SMALL_MAX && (small_map & ((uintptr_t)1 << (nb / ALIGN)))) {
+    p = small_bin[nb / ALIGN].next;
+  } else if ((p = bin_fit(nb)) == NULL) {
+    size_t avail = csize(top);
+    if (avail < nb + MIN_CHUNK) return NULL;
+    p = top;
+    top = chunk_at(p, nb);
+    top->head = (avail - nb) | PREV_INUSE;
+    p->head = nb | INUSE | (p->head & PREV_INUSE);
+    return chunk2mem(p);
+  }
+
+  bin_remove(p);
+  size_t sz = csize(p);
+  if (sz - nb >= MIN_CHUNK) {
+    p->head = nb | INUSE | PREV_INUSE;
+    set_free(chunk_at(p, nb), sz - nb);
+  } else {
+    p->head |= INUSE;
+    chunk_at(p, sz)->head |= PREV_INUSE;
+  }
+  return chunk2mem(p);
+}
+
+static void do_free(chunk_t *p) {
+  size_t sz = csize(p);
+  chunk_t *nxt = chunk_at(p, sz);
+  if (!(p->head & PREV_INUSE)) {
+    p = (chunk_t *)((char *)p - p->prev_size);
+    bin_remove(p);
+    sz += csize(p);
+  }
+  if (nxt == top) {
+    top = p;
+    top->head = (sz + csize(nxt)) | PREV_INUSE;
+    return;
+  }
+  if (!(nxt->head & INUSE)) {
+    bin_remove(nxt);
+    sz += csize(nxt);
+  }
+  set_free(p, sz);
+}
+
+#ifdef __KLIB_MALLOC_MPE__
+#define MAX_CPU   16
+#define CACHE_MAX 8
+
+// freed small chunks stay INUSE in the cache, so nobody merges with them
+static struct {
+  chunk_t *list[NR_SMALL];
+  uint8_t count[NR_SMALL];
+} cache[MAX_CPU];
+static int malloc_lk = 0;
+
+static inline void lock()   { while (atomic_xchg(&malloc_lk, 1)); }
+static inline void unlock() { atomic_xchg(&malloc_lk, 0); }
+
+// give the cached chunks of this CPU back to the bins, with the lock held
+static bool cache_flush(int cpu) {
+  bool flushed = false;
+  for (int i = 0; i < NR_SMALL; i ++) {
+    while (cache[cpu].list[i] != NULL) {
+      chunk_t *p = cache[cpu].list[i];
+      cache[cpu].list[i] = p->next;
+      do_free(p);
+      flushed = true;
+    }
+    cache[cpu].count[i] = 0;
+  }
+  return flushed;
+}
+#else
+static inline void lock()   { }
+static inline void unlock() { }
+#endif
+
 void *malloc(size_t size) {
-  // On native, malloc() will be called during initializaion of C runtime.
-  // Therefore do not call panic() here, else it will yield a dead recursion:
-  //   panic() -> putchar() -> (glibc) -> malloc() -> panic()
-#if !(defined(__ISA_NATIVE__) && defined(__NATIVE_USE_KLIB__))
-  panic("Not implemented");
+  if (size > (size_t)-1 / 2) return NULL;
+  size_t nb = ROUNDUP(size + sizeof(size_t), ALIGN);
+  if (nb < MIN_CHUNK) nb = MIN_CHUNK;
+
+#ifdef __KLIB_MALLOC_MPE__
+  if (nb < SMALL_MAX) {
+    int i = nb / ALIGN, cpu = cpu_current();
+    chunk_t *p = cache[cpu].list[i];
+    if (p != NULL) {
+      cache[cpu].list[i] = p->next;
+      cache[cpu].count[i] --;
+      return chunk2mem(p);
+    }
+  }
 #endif
-  return NULL;
+
+  lock();
+  void *ret = NULL;
+  if (top != NULL || heap_init()) {
+    ret = do_malloc(nb);
+#ifdef __KLIB_MALLOC_MPE__
+    if (ret == NULL && cache_flush(cpu_current())) ret = do_malloc(nb);
+#endif
+  }
+  unlock();
+  return ret;
 }
 
 void free(void *ptr) {
+  if (ptr == NULL) return;
+  chunk_t *p = mem2chunk(ptr);
+  panic_on(!(p->head & INUSE), "free() on a free chunk");
+
+#ifdef __KLIB_MALLOC_MPE__
+  size_t sz = csize(p);
+  if (sz < SMALL_MAX) {
+    int i = sz / ALIGN, cpu = cpu_current();
+    if (cache[cpu].count[i] < CACHE_MAX) {
+      p->next = cache[cpu].list[i];
+      cache[cpu].list[i] = p;
+      cache[cpu].count[i] ++;
+      return;
+    }
+  }
+#endif
+
+  lock();
+  do_free(p);
+  unlock();
 }
 
 #endif
@@ -4,44 +4,190 @@
 
 #if !defined(__ISA_NATIVE__) || defined(__NATIVE_USE_KLIB__)
 
+// Word-sized accesses below are always aligned, so a load never crosses
+// a page or the end of the heap even when it reads past the terminator.
+typedef uintptr_t __attribute__((may_alias)) word_t;
+#define WSIZE sizeof(word_t)
+#define WMASK (WSIZE - 1)
+#define ONES  (~(word_t)0 / 0xff)
+#define HIGHS (ONES << 7)
+// nonzero iff some byte of x is zero
+#define HASZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+#define COALIGNED(a, b) ((((uintptr_t)(a) ^ (uintptr_t)(b)) & WMASK) == 0)
+
 size_t strlen(const char *s) {
-  panic("Not implemented");
+  const char *p = s;
+  for (; (uintptr_t)p & WMASK; p ++) {
+    if (*p == '\0') return p - s;
+  }
+  const word_t *w = (const word_t *)p;
+  while (!HASZERO(*w)) w ++;
+  for (p = (const char *)w; *p != '\0'; p ++);
+  return p - s;
 }
 
+// The routines on two strings only go word by word when both of them
+// can be aligned at the same time.
 char *strcpy(char *dst, const char *src) {
-  panic("Not implemented");
+  char *d = dst;
+  if (COALIGNED(d, src)) {
+    for (; (uintptr_t)src & WMASK; d ++, src ++) {
+      if ((*d = *src) == '\0') return dst;
+    }
+    word_t *dw = (word_t *)d;
+    const word_t *sw = (const word_t *)src;
+    for (; !HASZERO(*sw); dw ++, sw ++) *dw = *sw;
+    d = (char *)dw;
+    src = (const char *)sw;
+  }
+  while ((*d ++ = *src ++) != '\0');
+  return dst;
 }
 
 char *strncpy(char *dst, const char *src, size_t n) {
-  panic("Not implemented");
+  char *d = dst;
+  if (COALIGNED(d, src)) {
+    for (; n > 0 && ((uintptr_t)src & WMASK) && *src != '\0'; n --) *d ++ = *src ++;
+    if (((uintptr_t)src & WMASK) == 0) {
+      word_t *dw = (word_t *)d;
+      const word_t *sw = (const word_t *)src;
+      for (; n >= WSIZE && !HASZERO(*sw); n -= WSIZE) *dw ++ = *sw ++;
+      d = (char *)dw;
+      src = (const char *)sw;
+    }
+  }
+  for (; n > 0 && *src != '\0'; n --) *d ++ = *src ++;
+  memset(d, 0, n);
+  return dst;
 }
 
 char *strcat(char *dst, const char *src) {
-  panic("Not implemented");
+  strcpy(dst + strlen(dst), src);
+  return dst;
 }
 
 int strcmp(const char *s1, const char *s2) {
-  panic("Not implemented");
+  if (COALIGNED(s1, s2)) {
+    for (; (uintptr_t)s1 & WMASK; s1 ++, s2 ++) {
+      if (*s1 != *s2 || *s1 == '\0') return (uint8_t)*s1 - (uint8_t)*s2;
+    }
+    const word_t *w1 = (const word_t *)s1, *w2 = (const word_t *)s2;
+    for (; *w1 == *w2 && !HASZERO(*w1); w1 ++, w2 ++);
+    s1 = (const char *)w1;
+    s2 = (const char *)w2;
+  }
+  for (; *s1 == *s2 && *s1 != '\0'; s1 ++, s2 ++);
+  return (uint8_t)*s1 - (uint8_t)*s2;
 }
 
 int strncmp(const char *s1, const char *s2, size_t n) {
-  panic("Not implemented");
+  if (COALIGNED(s1, s2)) {
+    for (; n > 0 && ((uintptr_t)s1 & WMASK); n --, s1 ++, s2 ++) {
+      if (*s1 != *s2 || *s1 == '\0') return (uint8_t)*s1 - (uint8_t)*s2;
+    }
+    const word_t *w1 = (const word_t *)s1, *w2 = (const word_t *)s2;
+    for (; n >= WSIZE && *w1 == *w2 && !HASZERO(*w1); n -= WSIZE, w1 ++, w2 ++);
+    s1 = (const char *)w1;
+    s2 = (const char *)w2;
+  }
+  for (; n > 0; n --, s1 ++, s2 ++) {
+    if (*s1 != *s2 || *s1 == '\0') return (uint8_t)*s1 - (uint8_t)*s2;
+  }
+  return 0;
 }
 
+// The mem* routines move a word at a time once the destination is
+// aligned, four words per iteration for long runs. When the source is
+// aligned differently from the destination, memcpy() still loads aligned
+// words and merges each pair with shifts, which needs little endian.
+// Some ISAs replace them with assembly, see am/src/riscv/string.S.
+#ifndef __KLIB_MEM_ASM__
 void *memset(void *s, int c, size_t n) {
-  panic("Not implemented");
+  uint8_t *d = s;
+  if (n >= 2 * WSIZE) {
+    word_t w = (uint8_t)c * ONES;
+    for (; (uintptr_t)d & WMASK; n --) *d ++ = c;
+    word_t *dw = (word_t *)d;
+    for (; n >= 4 * WSIZE; n -= 4 * WSIZE, dw += 4) {
+      dw[0] = w; dw[1] = w; dw[2] = w; dw[3] = w;
+    }
+    for (; n >= WSIZE; n -= WSIZE) *dw ++ = w;
+    d = (uint8_t *)dw;
+  }
+  while (n --) *d ++ = c;
+  return s;
 }
 
-void *memmove(void *dst, const void *src, size_t n) {
-  panic("Not implemented");
+void *memcpy(void *out, const void *in, size_t n) {
+  uint8_t *d = out;
+  const uint8_t *s = in;
+  if (n >= 2 * WSIZE) {
+    for (; (uintptr_t)d & WMASK; n --) *d ++ = *s ++;
+    word_t *dw = (word_t *)d;
+    int off = (uintptr_t)s & WMASK;
+    if (off == 0) {
+      const word_t *sw = (const word_t *)s;
+      for (; n >= 4 * WSIZE; n -= 4 * WSIZE, dw += 4, sw += 4) {
+        word_t w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+        dw[0] = w0; dw[1] = w1; dw[2] = w2; dw[3] = w3;
+      }
+      for (; n >= WSIZE; n -= WSIZE) *dw ++ = *sw ++;
+      s = (const uint8_t *)sw;
+    }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    else {
+      // the aligned words loaded never go beyond the word holding the last byte
+      const word_t *sw = (const word_t *)(s - off);
+      int lo = off * 8, hi = WSIZE * 8 - lo;
+      word_t w = *sw ++;
+      for (; n >= WSIZE; n -= WSIZE) {
+        word_t next = *sw ++;
+        *dw ++ = (w >> lo) | (next << hi);
+        w = next;
+      }
+      s = (const uint8_t *)sw - WSIZE + off;
+    }
+#endif
+    d = (uint8_t *)dw;
+  }
+  while (n --) *d ++ = *s ++;
+  return out;
 }
 
-void *memcpy(void *out, const void *in, size_t n) {
-  panic("Not implemented");
+void *memmove(void *dst, const void *src, size_t n) {
+  // copying forward is safe unless dst is inside [src, src + n)
+  if ((uintptr_t)dst - (uintptr_t)src >= n) return memcpy(dst, src, n);
+  uint8_t *d = (uint8_t *)dst + n;
+  const uint8_t *s = (const uint8_t *)src + n;
+  if (n >= 2 * WSIZE && COALIGNED(d, s)) {
+    for (; (uintptr_t)d & WMASK; n --) *-- d = *-- s;
+    word_t *dw = (word_t *)d;
+    const word_t *sw = (const word_t *)s;
+    for (; n >= WSIZE; n -= WSIZE) *-- dw = *-- sw;
+    d = (uint8_t *)dw;
+    s = (const uint8_t *)sw;
+  }
+  while (n --) *-- d = *-- s;
+  return dst;
 }
 
 int memcmp(const void *s1, const void *s2, size_t n) {
-  panic("Not implemented");
+  const uint8_t *p1 = s1, *p2 = s2;
+  if (n >= 2 * WSIZE && COALIGNED(p1, p2)) {
+    for (; (uintptr_t)p1 & WMASK; n --, p1 ++, p2 ++) {
+      if (*p1 != *p2) return *p1 - *p2;
+    }
+    const word_t *w1 = (const word_t *)p1, *w2 = (const word_t *)p2;
+    // stop at the first different word, and find the byte below
+    for (; n >= WSIZE && *w1 == *w2; n -= WSIZE) { w1 ++; w2 ++; }
+    p1 = (const uint8_t *)w1;
+    p2 = (const uint8_t *)w2;
+  }
+  for (; n > 0; n --, p1 ++, p2 ++) {
+    if (*p1 != *p2) return *p1 - *p2;
+  }
+  return 0;
 }
+#endif
 
 #endif
@@ -4,5 +4,8 @@ CFLAGS        += $(COMMON_CFLAGS) -static
 ASFLAGS       += $(COMMON_CFLAGS) -O0
 LDFLAGS       += -melf64lriscv
 
+# mem*() come from riscv/string.S instead of klib
+CFLAGS        += -D__KLIB_MEM_ASM__
+
 # overwrite ARCH_H defined in $(AM_HOME)/Makefile
 ARCH_H := arch/riscv.h
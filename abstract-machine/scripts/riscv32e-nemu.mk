@@ -7,4 +7,5 @@ LDFLAGS       += -melf32lriscv                     # overwrite
 AM_SRCS += riscv/nemu/start.S \
            riscv/nemu/cte.c \
            riscv/nemu/trap.S \
-           riscv/nemu/vme.c
+           riscv/nemu/vme.c \
+           riscv/string.S
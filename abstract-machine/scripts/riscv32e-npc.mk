@@ -3,7 +3,8 @@ include $(AM_HOME)/scripts/platform/npc.mk
 COMMON_CFLAGS += -march=rv32e_zicsr -mabi=ilp32e  # overwrite
 LDFLAGS       += -melf32lriscv                    # overwrite
 
-AM_SRCS += riscv/npc/libgcc/div.S \
+AM_SRCS += riscv/string.S \
+           riscv/npc/libgcc/div.S \
            riscv/npc/libgcc/muldi3.S \
            riscv/npc/libgcc/multi3.c \
            riscv/npc/libgcc/ashldi3.c \
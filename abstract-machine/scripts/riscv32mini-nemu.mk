@@ -6,6 +6,11 @@ CC = rvmini-gcc
 AS = rvmini-gcc
 CXX = rvmini-g++
 
+# lookup tables for and/or/xor (byte or nibble) and fusing of shift pairs,
+# see tools/rvmini/rvmini-common.sh; run `make clean` after changing them
+export RVMINI_LUT  ?= byte
+export RVMINI_FUSE ?= 0
+
 CFLAGS  += -DISA_H=\"riscv/riscv.h\"
 COMMON_CFLAGS += -march=rv32i_zicsr -mabi=ilp32  # overwrite
 LDFLAGS       += -melf32lriscv                   # overwrite
@@ -13,7 +18,8 @@ LDFLAGS       += -melf32lriscv                   # overwrite
 AM_SRCS += riscv/nemu/start.S \
            riscv/nemu/cte.c \
            riscv/nemu/trap.S \
-           riscv/nemu/vme.c
+           riscv/nemu/vme.c \
+           riscv/string.S
 
 AM_SRCS += riscv/npc/libgcc/div.S \
            riscv/npc/libgcc/muldi3.S \
@@ -5,4 +5,5 @@ CFLAGS  += -DISA_H=\"riscv/riscv.h\"
 AM_SRCS += riscv/nemu/start.S \
            riscv/nemu/cte.c \
            riscv/nemu/trap.S \
-           riscv/nemu/vme.c
+           riscv/nemu/vme.c \
+           riscv/string.S
@@ -5,6 +5,7 @@ AM_SRCS := riscv/spike/trm.c \
            riscv/spike/timer.c \
            riscv/spike/start.S \
            riscv/spike/htif.S \
+           riscv/string.S \
            platform/dummy/cte.c \
            platform/dummy/vme.c \
            platform/dummy/mpe.c \
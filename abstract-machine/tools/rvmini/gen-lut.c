@@ -1,10 +1,12 @@
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
-#define LUT_BIN "lut.bin"
-
-int main() {
-  FILE *fp = fopen(LUT_BIN, "w");
+// usage: gen-lut [nibble]
+// The layout of the tables must match inst-replace.h.
+int main(int argc, char *argv[]) {
+  int nibble = (argc > 1 && strcmp(argv[1], "nibble") == 0);
+  FILE *fp = fopen(nibble ? "lut-nibble.bin" : "lut.bin", "w");
   assert(fp != NULL);
 
 #define gen_table(name, row, col, entry_size, expr) do { \
@@ -16,9 +18,23 @@ int main() {
   } \
 } while (0)
 
-  gen_table(_and8_table, 256, 256, 1, j & i);
-  gen_table(_or8_table,  256, 256, 1, j | i);
-  gen_table(_xor8_table, 256, 256, 1, j ^ i);
+  if (nibble) {
+    // split a byte into nibbles
+    gen_table(_hi4x16_table, 1, 256, 1, i & 0xf0);
+    gen_table(_hi4_table,    1, 256, 1, i >> 4);
+    gen_table(_lo4x16_table, 1, 256, 1, (i & 0xf) << 4);
+    gen_table(_lo4_table,    1, 256, 1, i & 0xf);
+    // indexed by (x << 4) | y, the second row is shifted to the high nibble
+    gen_table(_and4_table, 2, 256, 1, ((i >> 4) & (i & 0xf)) << (j * 4));
+    gen_table(_or4_table,  2, 256, 1, ((i >> 4) | (i & 0xf)) << (j * 4));
+    gen_table(_xor4_table, 2, 256, 1, ((i >> 4) ^ (i & 0xf)) << (j * 4));
+    gen_table(_not8_table,   1, 256, 1, ~i & 0xff);
+    gen_table(_shamt_table,  1, 256, 1, i & 0x1f);
+  } else {
+    gen_table(_and8_table, 256, 256, 1, j & i);
+    gen_table(_or8_table,  256, 256, 1, j | i);
+    gen_table(_xor8_table, 256, 256, 1, j ^ i);
+  }
   gen_table(_sll8_table, 32, 256, 4, (unsigned)i << j);
   gen_table(_srl8_table, 32, 256, 4, ((unsigned)i << 24) >> j);
   gen_table(_sra8_table, 32, 256, 4, (int)((unsigned)i << 24) >> j);
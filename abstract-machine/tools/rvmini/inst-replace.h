@@ -72,10 +72,29 @@ _or1_table: .byte 0, 1, 1, 1
 _logic_shift_table:
 .incbin _LUT_BIN_PATH  # defined in command line flags
 
+#ifdef _LUT_NIBBLE
+# and/or/xor go through 16x16 tables, ~3 KiB instead of 192 KiB, see gen-lut.c
+#define NIB_HI4X16 0      // b & 0xf0
+#define NIB_HI4    256    // b >> 4
+#define NIB_LO4X16 512    // (b & 0xf) << 4
+#define NIB_LO4    768    // b & 0xf
+#define NIB_and    1024   // [(x << 4) | y] = x op y, and (x op y) << 4 256 bytes later
+#define NIB_or     1536
+#define NIB_xor    2048
+#define NIB_NOT8   2560   // ~b
+#define NIB_SHAMT  2816   // b & 0x1f
+#define NIB_BASE   NIB_and  // keep all the offsets above within an immediate
+#define _not8_table  (_logic_shift_table + NIB_NOT8)
+#define _shamt_table (_logic_shift_table + NIB_SHAMT)
+#define _sll8_table  (_logic_shift_table + 3072)
+#else
 #define _and8_table _logic_shift_table
 #define _or8_table  (_and8_table + 256 * 256)
 #define _xor8_table (_or8_table  + 256 * 256)
+#define _not8_table  (_xor8_table + (0xff << 8))
+#define _shamt_table (_and8_table + (0x1f << 8))
 #define _sll8_table (_xor8_table + 256 * 256)
+#endif
 #define _srl8_table (_sll8_table + 32 * 256 * 4)
 #define _sra8_table (_srl8_table + 32 * 256 * 4)
 
@@ -160,6 +179,35 @@ _logic_shift_table:
   slt_template _sltu1_table, \rd, \rs1, \rs2
 .endm
 
+#ifdef _LUT_NIBBLE
+# C[boffset] = (A op B)[boffset], one nibble at a time, with base pointing
+# to the tables at NIB_BASE
+.macro logic4_byte_internal base, op, boffset
+  lbu tp, SP_VAR_BYTE(VAR_A, \boffset)
+  add tp, \base, tp
+  lbu gp, (NIB_HI4X16 - NIB_BASE)(tp)
+  lbu tp, SP_VAR_BYTE(VAR_B, \boffset)
+  add tp, \base, tp
+  lbu tp, (NIB_HI4 - NIB_BASE)(tp)
+  add tp, tp, gp
+  add tp, \base, tp
+  lbu gp, (\op - NIB_BASE + 256)(tp)
+  sb gp, SP_VAR_BYTE(VAR_C, \boffset)
+
+  lbu tp, SP_VAR_BYTE(VAR_A, \boffset)
+  add tp, \base, tp
+  lbu gp, (NIB_LO4X16 - NIB_BASE)(tp)
+  lbu tp, SP_VAR_BYTE(VAR_B, \boffset)
+  add tp, \base, tp
+  lbu tp, (NIB_LO4 - NIB_BASE)(tp)
+  add tp, tp, gp
+  add tp, \base, tp
+  lbu tp, (\op - NIB_BASE)(tp)
+  lbu gp, SP_VAR_BYTE(VAR_C, \boffset)
+  add gp, gp, tp
+  sb gp, SP_VAR_BYTE(VAR_C, \boffset)
+.endm
+#else
 .macro logic8_byte_internal lut_reg, boffset
   lbu tp, SP_VAR_BYTE(VAR_A, \boffset)
   sb tp, SP_VAR_BYTE(VAR_D, 1)
@@ -170,6 +218,7 @@ _logic_shift_table:
   lbu tp, (tp)
   sb tp, SP_VAR_BYTE(VAR_C, \boffset)
 .endm
+#endif
 
 .macro logic lut, rd, rs1, rs2
   .if \rd == x0
@@ -186,6 +235,16 @@ _logic_shift_table:
   .endif
   sw \rs1, SP_VAR(VAR_A)
   sw \rs2, SP_VAR(VAR_B)
+#ifdef _LUT_NIBBLE
+  PUSH(gp, 3)
+  la \rd, (_logic_shift_table + NIB_BASE)
+
+  logic4_byte_internal \rd, \lut, 3
+  logic4_byte_internal \rd, \lut, 2
+  logic4_byte_internal \rd, \lut, 1
+  logic4_byte_internal \rd, \lut, 0
+  POP(gp, 3)
+#else
   la \rd, \lut
   sw x0, SP_VAR(VAR_D)
 
@@ -193,15 +252,24 @@ _logic_shift_table:
   logic8_byte_internal \rd, 2
   logic8_byte_internal \rd, 1
   logic8_byte_internal \rd, 0
+#endif
 
   lw \rd, SP_VAR(VAR_C)
 .endm
 
+#ifdef _LUT_NIBBLE
+#define def_logic(name) \
+  .macro name rd, rs1, rs2 ;\
+    SET_DEBUG_LABEL(name); \
+    logic concat(NIB_, name), \rd, \rs1, \rs2; \
+  .endm
+#else
 #define def_logic(name) \
   .macro name rd, rs1, rs2 ;\
     SET_DEBUG_LABEL(name); \
     logic concat(_, concat(name, 8_table)), \rd, \rs1, \rs2; \
   .endm
+#endif
 
 def_logic(and)
 def_logic(or)
@@ -382,7 +450,7 @@ LABEL_NAME:
 .macro getshamt rd, rs1
   sb \rs1, SP_VAR_BYTE(VAR_B, 0)
   lbu \rd, SP_VAR_BYTE(VAR_B, 0)
-  la tp, (_and8_table + (0x1f << 8))
+  la tp, _shamt_table
   add \rd, \rd, tp
   lbu \rd, (\rd)
 .endm
@@ -561,10 +629,87 @@ LABEL_NAME:
 
 def_itype(slti, slt)
 def_itype(sltiu, sltu)
-def_itype(andi, and)
 def_itype(ori, or)
 def_itype(xori, xor)
 
+#ifndef _RVMINI_FUSE
+def_itype(andi, and)
+#else
+# rvmini-common.sh rewrites some instruction pairs into the macros below,
+# which take a single table lookup instead of two shifts
+
+.macro andi_lookup rd, rs1, table
+  sw \rs1, SP_VAR(VAR_C)
+  lbu \rd, SP_VAR_BYTE(VAR_C, 0)
+  la tp, \table
+  add tp, tp, \rd
+  lbu \rd, (tp)
+.endm
+
+.macro andi rd, rs1, imm
+  SET_DEBUG_LABEL(andi)
+  .if \imm == 0xff
+    getbyte \rd, \rs1, 0
+    .exitm
+  .endif
+#ifdef _LUT_NIBBLE
+  .if \imm == 0xf
+    andi_lookup \rd, \rs1, (_logic_shift_table + NIB_LO4)
+  .elseif \imm == 0xf0
+    andi_lookup \rd, \rs1, (_logic_shift_table + NIB_HI4X16)
+  .elseif \imm == 0x1f
+    andi_lookup \rd, \rs1, _shamt_table
+  .else
+    li tp, \imm
+    and \rd, \rs1, tp
+  .endif
+#else
+  .if \imm > 0 && \imm < 0xff
+    andi_lookup \rd, \rs1, (_and8_table + (\imm << 8))
+  .else
+    li tp, \imm
+    and \rd, \rs1, tp
+  .endif
+#endif
+.endm
+
+# slli rd, rs1, 24; srai rd, rd, 24
+.macro sext8 rd, rs1
+  SET_DEBUG_LABEL(sext8)
+  sw \rs1, SP_VAR(VAR_A)
+  la tp, (_sra8_table + (24 << 10))
+  lbu \rd, SP_VAR_BYTE(VAR_A, 0)
+  slli \rd, \rd, 2 # word per entry
+  add tp, tp, \rd
+  lw \rd, (tp)
+.endm
+
+# slli rd, rs1, 16; srli rd, rd, 16
+.macro zext16 rd, rs1
+  SET_DEBUG_LABEL(zext16)
+  sw \rs1, SP_VAR(VAR_B)
+  sw x0, SP_VAR(VAR_A)
+  lbu tp, SP_VAR_BYTE(VAR_B, 1)
+  sb tp, SP_VAR_BYTE(VAR_A, 1)
+  lbu tp, SP_VAR_BYTE(VAR_B, 0)
+  sb tp, SP_VAR_BYTE(VAR_A, 0)
+  lw \rd, SP_VAR(VAR_A)
+.endm
+
+# slli rd, rs1, 16; srai rd, rd, 16
+.macro sext16 rd, rs1
+  SET_DEBUG_LABEL(sext16)
+  sw \rs1, SP_VAR(VAR_A)
+  la tp, (_sra8_table + (16 << 10))
+  lbu \rd, SP_VAR_BYTE(VAR_A, 1)
+  slli \rd, \rd, 2 # word per entry
+  add tp, tp, \rd
+  lw \rd, (tp)  # sign-extended byte 1, shifted left by 8
+  lbu tp, SP_VAR_BYTE(VAR_A, 0)
+  add \rd, \rd, tp
+.endm
+#endif
+
 .macro lb rd, addr
   sw x0, SP_VAR(VAR_A)
   lbu \rd, \addr
@@ -626,7 +771,7 @@ def_itype(xori, xor)
 .macro not rd, rs1
   PUSH(gp, 3)
   sw \rs1, SP_VAR(VAR_C)
-  la tp, (_xor8_table + (0xff << 8))
+  la tp, _not8_table
 
   lbu gp, SP_VAR_BYTE(VAR_C, 3)
   add gp, gp, tp
@@ -20,11 +20,35 @@ symbol="[[:alnum:]_]+"
 sed -E -i -e "s/(l[bhw]u?)${sp}(${reg})${comma}(${symbol})(${sp}[-+]${sp}${symbol})?${sp}\$/la \2, \3\4; \1 \2, 0(\2);/" \
           -e "s/(s[bhw])${sp}(${reg})${comma}(${symbol})(${sp}[-+]${sp}${symbol})?${comma}(${reg})${sp}\$/la \5, \3\4; \1 \2, 0(\5);/" $dst_S
 
+# options from the environment:
+#   RVMINI_LUT=nibble  and/or/xor with 16x16 tables instead of 256x256 ones
+#   RVMINI_FUSE=1      replace some instruction pairs with one table lookup
+rvmini_flags=
+
+# fuse the pairs of shifts the compiler emits for zero/sign extension
+if [ "$RVMINI_FUSE" = "1" ]; then
+  sh="[[:space:]]+"
+  pair="^($sp)slli$sh($reg)$comma($reg)${comma}(24|16)\n${sp}sr([al])i$sh\2$comma\2$comma\4$sp\$"
+  sed -E -i -e '$!N' \
+            -e "s/$pair/\1\5\4 \2, \3/" \
+            -e "s/^($sp)a24 /\1sext8 /; s/^($sp)l24 ($reg), ($reg)\$/\1andi \2, \3, 255/" \
+            -e "s/^($sp)a16 /\1sext16 /; s/^($sp)l16 /\1zext16 /" \
+            -e 'P;D' $dst_S
+  rvmini_flags+=" -D_RVMINI_FUSE"
+fi
+
 # insert inst-replace.h to each .h files
 rvmini_path=$AM_HOME/tools/rvmini
-lut_bin_path=$rvmini_path/lut.bin
+if [ "$RVMINI_LUT" = "nibble" ]; then
+  lut_mode=nibble
+  lut_bin_path=$rvmini_path/lut-nibble.bin
+  rvmini_flags+=" -D_LUT_NIBBLE"
+else
+  lut_mode=
+  lut_bin_path=$rvmini_path/lut.bin
+fi
 sed -i "1i#include \"$rvmini_path/inst-replace.h\"" $dst_S
-flock $rvmini_path/.lock -c "test -e $lut_bin_path || (cd $rvmini_path && gcc gen-lut.c && ./a.out && rm a.out)"
+flock $rvmini_path/.lock -c "test -e $lut_bin_path || (cd $rvmini_path && gcc gen-lut.c && ./a.out $lut_mode && rm a.out)"
 
 src_dir=`dirname $src`
-riscv64-linux-gnu-gcc -I$src_dir $flags -D_LUT_BIN_PATH=\"$lut_bin_path\" -Wno-trigraphs -c -o $dst $dst_S
+riscv64-linux-gnu-gcc -I$src_dir $flags $rvmini_flags -D_LUT_BIN_PATH=\"$lut_bin_path\" -Wno-trigraphs -c -o $dst $dst_S
@@ -19,11 +19,35 @@
 #include <common.h>
 
 void cpu_exec(uint64_t n);
+void cpu_exec_silent(uint64_t n);
+extern bool g_exec_silent;
 
 void set_nemu_state(int state, vaddr_t pc, int halt_ret);
 void invalid_inst(vaddr_t thispc);
 
+// Interrupts are not polled by every instruction. They are only checked
+// when the number of guest instructions reaches this value, which is
+// lowered by everything that may make an interrupt taken, e.g. a device
+// raising an interrupt, or a guest write to the interrupt enable bits.
+extern uint64_t g_intr_check_inst;
+/* check the interrupts once `inst' guest instructions are executed, can be called by any thread */
+void cpu_check_intr_at(uint64_t inst);
+#define cpu_check_intr() cpu_check_intr_at(0)
+
 #define NEMUTRAP(thispc, code) set_nemu_state(NEMU_END, thispc, code)
 #define INV(thispc) invalid_inst(thispc)
 
+#ifdef CONFIG_FUZZ_COVERAGE
+// AFL-style edge coverage, the map is provided by the host of libnemu
+extern uint8_t *g_cov_map;
+extern uint32_t g_cov_mask, g_cov_prev;
+
+// record the edge from the previously executed pc to `pc'
+static inline void cov_edge(vaddr_t pc) {
+  uint32_t cur = ((uint32_t)pc * 0x9e3779b1u >> 8) & g_cov_mask;
+  g_cov_map[cur ^ g_cov_prev] ++;
+  g_cov_prev = cur >> 1;
+}
+#endif
+
 #endif
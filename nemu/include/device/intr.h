@@ -0,0 +1,46 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __DEVICE_INTR_H__
+#define __DEVICE_INTR_H__
+
+#include <common.h>
+
+// interrupt sources of the PLIC
+enum {
+  IRQ_VIRTIO_BLK = 1,
+  IRQ_VIRTIO_NET = 2,
+  IRQ_SDCARD     = 3,
+  IRQ_SERIAL     = 10,
+  NR_IRQ         = 32,
+};
+
+// interrupt lines of the hart
+enum {
+  INTR_LINE_SOFT     = 1 << 0,
+  INTR_LINE_TIMER    = 1 << 1,
+  INTR_LINE_EXTERNAL = 1 << 2,
+};
+
+/* make the source `irq' pending at the PLIC, can be called by any thread */
+void dev_raise_intr(int irq);
+/* A claimed source is not pending any more. When its interrupt is completed,
+ * `level' is asked whether the device still has work, e.g. input left in
+ * its FIFO, and the source is pending again if so. */
+void dev_set_intr_level(int irq, bool (*level)());
+/* the interrupt lines driven by the CLINT and the PLIC */
+uint32_t dev_query_intr();
+
+#endif
@@ -17,6 +17,7 @@
 #define __DEVICE_MAP_H__
 
 #include <cpu/difftest.h>
+#include <memory/host.h>
 
 typedef void(*io_callback_t)(uint32_t, int, bool);
 uint8_t* new_space(int size);
@@ -50,7 +51,23 @@ void add_pio_map(const char *name, ioaddr_t addr,
 void add_mmio_map(const char *name, paddr_t addr,
         void *space, uint32_t len, io_callback_t callback);
 
-word_t map_read(paddr_t addr, int len, IOMap *map);
-void map_write(paddr_t addr, int len, word_t data, IOMap *map);
+void map_check_bound(IOMap *map, paddr_t addr);
+
+// inlined, so that the access to the space takes no switch when len is a constant
+static inline word_t map_read(paddr_t addr, int len, IOMap *map) {
+  assert(len >= 1 && len <= 8);
+  map_check_bound(map, addr);
+  paddr_t offset = addr - map->low;
+  if (map->callback != NULL) map->callback(offset, len, false); // prepare data to read
+  return host_read((uint8_t *)map->space + offset, len);
+}
+
+static inline void map_write(paddr_t addr, int len, word_t data, IOMap *map) {
+  assert(len >= 1 && len <= 8);
+  map_check_bound(map, addr);
+  paddr_t offset = addr - map->low;
+  host_write((uint8_t *)map->space + offset, len, data);
+  if (map->callback != NULL) map->callback(offset, len, true);
+}
 
 #endif
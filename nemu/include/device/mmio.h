@@ -21,4 +21,16 @@
 word_t mmio_read(paddr_t addr, int len);
 void mmio_write(paddr_t addr, int len, word_t data);
 
+// mmio_read8(), mmio_write8(), ..., for callers knowing the width
+#define decl_mmio_rw(bits) \
+  word_t concat(mmio_read, bits)(paddr_t addr); \
+  void concat(mmio_write, bits)(paddr_t addr, word_t data);
+
+decl_mmio_rw(8)
+decl_mmio_rw(16)
+decl_mmio_rw(32)
+#ifdef CONFIG_ISA64
+decl_mmio_rw(64)
+#endif
+
 #endif
@@ -27,6 +27,8 @@ typedef concat(__GUEST_ISA__, _ISADecodeInfo) ISADecodeInfo;
 // monitor
 extern unsigned char isa_logo[];
 void init_isa();
+/* reset the registers to the state after power on, the memory is kept */
+void isa_reset();
 
 // reg
 extern CPU_state cpu;
@@ -45,6 +47,8 @@ enum { MEM_RET_OK, MEM_RET_FAIL, MEM_RET_CROSS_PAGE };
 int isa_mmu_check(vaddr_t vaddr, int len, int type);
 #endif
 paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type);
+// drop the fault of an access not made by the guest, e.g. by sdb
+void isa_mmu_discard_fault();
 
 // interrupt/exception
 vaddr_t isa_raise_intr(word_t NO, vaddr_t epc);
@@ -0,0 +1,100 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __LIBNEMU_H__
+#define __LIBNEMU_H__
+
+// Embedding API of NEMU. Build NEMU with "Shared object" as the build
+// target and link the host program against the resulting .so.
+//
+// Every machine owns its registers, physical memory, MMIO regions and
+// execution state. Machines are not independent instances, but multiplexed
+// on the globals of one interpreter: the state of a machine is switched in
+// when it is used. So only one thread may call into the library at a time.
+// Nothing is printed by the library; errors are reported by return values.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct NEMUMachine NEMUMachine;
+typedef struct NEMUSnapshot NEMUSnapshot;
+
+// the reason why nemu_run() returns
+enum {
+  NEMU_EVENT_NONE,  // the instruction budget is used up
+  NEMU_EVENT_STOP,  // nemu_stop() is called, usually by an MMIO callback
+  NEMU_EVENT_TRAP,  // the guest executes nemu_trap, see nemu_trap_code()
+  NEMU_EVENT_ABORT, // invalid instruction or unhandled memory access
+};
+
+// `offset' is relative to the base of the region
+typedef uint64_t (*nemu_mmio_read_t)(void *opaque, uint64_t offset, int len);
+typedef void (*nemu_mmio_write_t)(void *opaque, uint64_t offset, int len, uint64_t data);
+
+NEMUMachine* nemu_create();
+void nemu_destroy(NEMUMachine *m);
+// set pc to the reset vector and clear registers, memory is kept
+void nemu_reset(NEMUMachine *m);
+
+// copy an image to the reset vector, return 0 on success
+int nemu_load_image(NEMUMachine *m, const void *buf, size_t size);
+
+// execute at most `n' instructions, return NEMU_EVENT_*
+int nemu_run(NEMUMachine *m, uint64_t n);
+// ask a running machine to return from nemu_run() after this instruction
+void nemu_stop(NEMUMachine *m);
+uint64_t nemu_inst_count(NEMUMachine *m);
+uint64_t nemu_trap_pc(NEMUMachine *m);
+int nemu_trap_code(NEMUMachine *m);
+
+// register `idx' in the same order as differential testing,
+// the last one (idx == nemu_nr_reg() - 1) is pc
+int nemu_nr_reg();
+uint64_t nemu_reg_read(NEMUMachine *m, int idx);
+void nemu_reg_write(NEMUMachine *m, int idx, uint64_t val);
+
+// guest physical memory, return 0 on success
+int nemu_mem_read(NEMUMachine *m, uint64_t paddr, void *buf, size_t n);
+int nemu_mem_write(NEMUMachine *m, uint64_t paddr, const void *buf, size_t n);
+
+// map [base, base + size) to the callbacks, return 0 on success
+int nemu_add_mmio(NEMUMachine *m, uint64_t base, uint64_t size,
+    nemu_mmio_read_t read, nemu_mmio_write_t write, void *opaque);
+
+// Save the registers and memory of a machine. Restoring the latest
+// snapshot of a machine only copies back the pages written since it
+// was taken or last restored, which makes it cheap enough to reset the
+// machine before every run, e.g. when fuzzing. MMIO regions and the
+// state behind their callbacks are not part of the snapshot.
+NEMUSnapshot* nemu_snapshot(NEMUMachine *m);
+int nemu_restore(NEMUMachine *m, NEMUSnapshot *snap);
+void nemu_snapshot_free(NEMUSnapshot *snap);
+
+// Record the edges between taken branches into `map' in the way of
+// AFL, `size' must be a power of 2. Only available when NEMU is built
+// with CONFIG_FUZZ_COVERAGE, return 0 on success.
+int nemu_set_coverage(NEMUMachine *m, uint8_t *map, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -18,22 +18,38 @@
 
 #include <common.h>
 
+// host_read8(), host_write8(), ..., for callers knowing the width
+#define def_host_rw(bits) \
+  static inline word_t concat(host_read, bits)(void *addr) { \
+    return *(concat3(uint, bits, _t) *)addr; \
+  } \
+  static inline void concat(host_write, bits)(void *addr, word_t data) { \
+    *(concat3(uint, bits, _t) *)addr = data; \
+  }
+
+def_host_rw(8)
+def_host_rw(16)
+def_host_rw(32)
+#ifdef CONFIG_ISA64
+def_host_rw(64)
+#endif
+
 static inline word_t host_read(void *addr, int len) {
   switch (len) {
-    case 1: return *(uint8_t  *)addr;
-    case 2: return *(uint16_t *)addr;
-    case 4: return *(uint32_t *)addr;
-    IFDEF(CONFIG_ISA64, case 8: return *(uint64_t *)addr);
+    case 1: return host_read8(addr);
+    case 2: return host_read16(addr);
+    case 4: return host_read32(addr);
+    IFDEF(CONFIG_ISA64, case 8: return host_read64(addr));
     default: MUXDEF(CONFIG_RT_CHECK, assert(0), return 0);
   }
 }
 
 static inline void host_write(void *addr, int len, word_t data) {
   switch (len) {
-    case 1: *(uint8_t  *)addr = data; return;
-    case 2: *(uint16_t *)addr = data; return;
-    case 4: *(uint32_t *)addr = data; return;
-    IFDEF(CONFIG_ISA64, case 8: *(uint64_t *)addr = data; return);
+    case 1: host_write8(addr, data); return;
+    case 2: host_write16(addr, data); return;
+    case 4: host_write32(addr, data); return;
+    IFDEF(CONFIG_ISA64, case 8: host_write64(addr, data); return);
     IFDEF(CONFIG_RT_CHECK, default: assert(0));
   }
 }
@@ -17,21 +17,96 @@
 #define __MEMORY_PADDR_H__
 
 #include <common.h>
+#include <memory/host.h>
 
 #define PMEM_LEFT  ((paddr_t)CONFIG_MBASE)
 #define PMEM_RIGHT ((paddr_t)CONFIG_MBASE + CONFIG_MSIZE - 1)
 #define RESET_VECTOR (PMEM_LEFT + CONFIG_PC_RESET_OFFSET)
 
+#ifdef CONFIG_PMEM_MALLOC
+extern uint8_t *pmem;
+#else
+extern uint8_t pmem[];
+#endif
+
 /* convert the guest physical address in the guest program to host virtual address in NEMU */
-uint8_t* guest_to_host(paddr_t paddr);
+static inline uint8_t* guest_to_host(paddr_t paddr) { return pmem + paddr - CONFIG_MBASE; }
 /* convert the host virtual address in NEMU to guest physical address in the guest program */
 paddr_t host_to_guest(uint8_t *haddr);
+/* replace the backing store of pmem, return the old one */
+uint8_t* pmem_switch(uint8_t *new_pmem);
+
+#ifdef CONFIG_TARGET_SHARE
+/* one byte per page of pmem, set by every write to the page, NULL if not tracked */
+#define PMEM_DIRTY_SHIFT 12
+extern uint8_t *pmem_dirty;
+
+static inline void pmem_mark_dirty(paddr_t addr, int len) {
+  pmem_dirty[(addr - CONFIG_MBASE) >> PMEM_DIRTY_SHIFT] = 1;
+  pmem_dirty[(addr + len - 1 - CONFIG_MBASE) >> PMEM_DIRTY_SHIFT] = 1;
+}
+#endif
 
 static inline bool in_pmem(paddr_t addr) {
   return addr - CONFIG_MBASE < CONFIG_MSIZE;
 }
 
-word_t paddr_read(paddr_t addr, int len);
-void paddr_write(paddr_t addr, int len, word_t data);
+/* the accesses outside pmem: MMIO, the host of libnemu, or out of bound */
+word_t paddr_read_io(paddr_t addr, int len);
+void paddr_write_io(paddr_t addr, int len, word_t data);
+
+#define decl_paddr_io(bits) \
+  word_t concat(paddr_read_io, bits)(paddr_t addr); \
+  void concat(paddr_write_io, bits)(paddr_t addr, word_t data);
+
+decl_paddr_io(8)
+decl_paddr_io(16)
+decl_paddr_io(32)
+#ifdef CONFIG_ISA64
+decl_paddr_io(64)
+#endif
+
+// paddr_read8(), paddr_write8(), ..., where an access to pmem is inlined
+#define def_paddr_rw(bits) \
+  static inline word_t concat(paddr_read, bits)(paddr_t addr) { \
+    if (likely(in_pmem(addr))) return concat(host_read, bits)(guest_to_host(addr)); \
+    return concat(paddr_read_io, bits)(addr); \
+  } \
+  static inline void concat(paddr_write, bits)(paddr_t addr, word_t data) { \
+    if (likely(in_pmem(addr))) { \
+      concat(host_write, bits)(guest_to_host(addr), data); \
+      IFDEF(CONFIG_TARGET_SHARE, if (pmem_dirty) pmem_mark_dirty(addr, bits / 8)); \
+      return; \
+    } \
+    concat(paddr_write_io, bits)(addr, data); \
+  }
+
+def_paddr_rw(8)
+def_paddr_rw(16)
+def_paddr_rw(32)
+#ifdef CONFIG_ISA64
+def_paddr_rw(64)
+#endif
+
+// the switch is folded away when len is a constant
+static inline word_t paddr_read(paddr_t addr, int len) {
+  switch (len) {
+    case 1: return paddr_read8(addr);
+    case 2: return paddr_read16(addr);
+    case 4: return paddr_read32(addr);
+    IFDEF(CONFIG_ISA64, case 8: return paddr_read64(addr));
+    default: return paddr_read_io(addr, len);
+  }
+}
+
+static inline void paddr_write(paddr_t addr, int len, word_t data) {
+  switch (len) {
+    case 1: paddr_write8(addr, data); return;
+    case 2: paddr_write16(addr, data); return;
+    case 4: paddr_write32(addr, data); return;
+    IFDEF(CONFIG_ISA64, case 8: paddr_write64(addr, data); return);
+    default: paddr_write_io(addr, len, data); return;
+  }
+}
 
 #endif
@@ -18,9 +18,49 @@
 
 #include <common.h>
 
-word_t vaddr_ifetch(vaddr_t addr, int len);
-word_t vaddr_read(vaddr_t addr, int len);
-void vaddr_write(vaddr_t addr, int len, word_t data);
+// vaddr_ifetch8(), vaddr_read8(), vaddr_write8(), ..., each specialized
+// for its width down to the host access
+#define decl_vaddr_rw(bits) \
+  word_t concat(vaddr_ifetch, bits)(vaddr_t addr); \
+  word_t concat(vaddr_read, bits)(vaddr_t addr); \
+  void concat(vaddr_write, bits)(vaddr_t addr, word_t data);
+
+decl_vaddr_rw(8)
+decl_vaddr_rw(16)
+decl_vaddr_rw(32)
+#ifdef CONFIG_ISA64
+decl_vaddr_rw(64)
+#endif
+
+// the switch is folded away when len is a constant
+#define def_vaddr_read_any(f) \
+  static inline word_t f(vaddr_t addr, int len) { \
+    switch (len) { \
+      case 1: return concat(f, 8)(addr); \
+      case 2: return concat(f, 16)(addr); \
+      case 4: return concat(f, 32)(addr); \
+      IFDEF(CONFIG_ISA64, case 8: return concat(f, 64)(addr)); \
+      default: MUXDEF(CONFIG_RT_CHECK, assert(0), return 0); \
+    } \
+  }
+
+def_vaddr_read_any(vaddr_ifetch)
+def_vaddr_read_any(vaddr_read)
+
+static inline void vaddr_write(vaddr_t addr, int len, word_t data) {
+  switch (len) {
+    case 1: vaddr_write8(addr, data); return;
+    case 2: vaddr_write16(addr, data); return;
+    case 4: vaddr_write32(addr, data); return;
+    IFDEF(CONFIG_ISA64, case 8: vaddr_write64(addr, data); return);
+    IFDEF(CONFIG_RT_CHECK, default: assert(0));
+  }
+}
+
+/* drop every cached translation, the ISA caches are dropped when
+ * their epoch differs from g_tlb_epoch */
+void tlb_flush();
+extern uint32_t g_tlb_epoch;
 
 #define PAGE_SHIFT        12
 #define PAGE_SIZE         (1ul << PAGE_SHIFT)
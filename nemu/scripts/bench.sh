@@ -0,0 +1,118 @@
+#!/bin/bash
+#***************************************************************************************
+# Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+#
+# NEMU is licensed under Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#          http://license.coscl.org.cn/MulanPSL2
+#
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+# EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+# MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+#
+# See the Mulan PSL v2 for more details.
+#**************************************************************************************/
+
+# Measure the simulation frequency of NEMU, called by `make bench'.
+#   usage: bench.sh NEMU RUNS RESULT BASELINE IMG...
+# Every image runs RUNS times in batch mode, one run at a time. The inst/s
+# of each run is taken from the statistic printed by NEMU, and the mean is
+# reported with its 95% confidence interval. RESULT gets one line per image:
+#   image  guest-inst  mean-inst/s  ci95-inst/s  runs
+# and is compared with BASELINE if it exists. A change is only called out
+# when the two confidence intervals do not overlap.
+
+nemu=$1
+runs=$2
+result=$3
+baseline=$4
+shift 4
+
+if [ $# -eq 0 ]; then
+  echo "bench: no image to run"
+  exit 1
+fi
+
+out=$(dirname $result)
+mkdir -p $out
+: > $result.tmp
+rm -f $out/*.perf
+
+# strip the colors and the digit grouping of the monitor messages
+stat_of() {
+  sed -e 's/\x1b\[[0-9;]*m//g' $1 | grep -o "$2 = [0-9,]*" | tail -n 1 | grep -o "[0-9,]*$" | tr -d ,
+}
+
+for img in "$@"; do
+  name=$(basename $img .bin)
+  rates=
+  for ((r = 1; r <= runs; r ++)); do
+    log=$out/$name.out
+    if ! $nemu -b $img > $log 2>&1; then
+      echo "bench: $name does not hit good trap, see $log"
+      exit 1
+    fi
+    inst=$(stat_of $log "total guest instructions")
+    us=$(stat_of $log "host time spent")
+    if [ -z "$inst" ] || [ -z "$us" ] || [ "$us" -eq 0 ]; then
+      echo "bench: no statistic from $name, see $log"
+      exit 1
+    fi
+    rates="$rates $((inst * 1000000 / us))"
+    printf "\r+ BENCH %s (%d/%d)" $name $r $runs
+  done
+  printf "\n"
+  echo $name $inst $rates | awk '{
+    # two-sided 95% quantiles of the t distribution for 1..30 degrees of freedom
+    split("12.706 4.303 3.182 2.776 2.571 2.447 2.365 2.306 2.262 2.228 " \
+          "2.201 2.179 2.160 2.145 2.131 2.120 2.110 2.101 2.093 2.086 " \
+          "2.080 2.074 2.069 2.064 2.060 2.056 2.052 2.048 2.045 2.042", t, " ");
+    n = NF - 2; sum = 0; sq = 0;
+    for (i = 3; i <= NF; i ++) sum += $i;
+    mean = sum / n;
+    for (i = 3; i <= NF; i ++) sq += ($i - mean) ^ 2;
+    ci = (n > 1 ? (n - 1 <= 30 ? t[n - 1] : 1.960) * sqrt(sq / (n - 1) / n) : 0);
+    printf "%s %s %.0f %.0f %d\n", $1, $2, mean, ci, n;
+  }' >> $result.tmp
+
+  # hardware counters of one more run, if perf is usable
+  if command -v perf > /dev/null && perf stat -e task-clock true > /dev/null 2>&1; then
+    perf stat -o $out/$name.perf -e task-clock,cycles,instructions,branches,branch-misses,cache-misses \
+      $nemu -b $img > /dev/null 2>&1
+  fi
+done
+mv $result.tmp $result
+
+echo
+printf "%-28s %14s %14s %10s %10s\n" "image" "guest inst" "inst/s" "+-95%" "vs base"
+awk -v base="$baseline" '
+  BEGIN {
+    while (base != "" && (getline line < base) > 0) {
+      split(line, f, " ");
+      b_inst[f[1]] = f[2]; b_mean[f[1]] = f[3]; b_ci[f[1]] = f[4];
+    }
+  }
+  {
+    cmp = "-";
+    if ($1 in b_mean) {
+      d = ($3 - b_mean[$1]) * 100 / b_mean[$1];
+      cmp = sprintf("%+.1f%%", d);
+      if ($3 - $4 <= b_mean[$1] + b_ci[$1] && $3 + $4 >= b_mean[$1] - b_ci[$1]) cmp = cmp "~";
+      if ($2 != b_inst[$1]) cmp = cmp " (guest inst differ)";
+    }
+    printf "%-28s %14s %14s %10s %10s\n", $1, $2, $3, $4, cmp;
+  }' $result
+if [ -f "$baseline" ]; then
+  echo "(~: within the noise of $baseline)"
+else
+  echo "(no baseline, save one with \`make bench-baseline')"
+fi
+
+for f in $out/*.perf; do
+  [ -f "$f" ] || continue
+  echo
+  echo "perf stat of $(basename $f .perf):"
+  grep -E "task-clock|cycles|instructions|branch|cache" $f
+done
+exit 0
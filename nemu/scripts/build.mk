@@ -55,3 +55,27 @@ $(BINARY):: $(OBJS) $(ARCHIVES)
 
 clean:
 	-rm -rf $(BUILD_DIR)
+
+# Measure the simulation frequency, see scripts/bench.sh. Images are run
+# with batch mode, so they must not need input.
+#   make bench [BENCH_IMGS="a.bin b.bin"] [BENCH_RUNS=10]
+#   make bench-baseline     # compare the following runs with this one
+BENCH_RUNS     ?= 5
+BENCH_RESULT    = $(BUILD_DIR)/bench/result.txt
+BENCH_BASELINE ?= $(NEMU_HOME)/bench-baseline.txt
+BENCH_AM_IMG    = $(AM_HOME)/bench/micro/build/micro-$(GUEST_ISA)-nemu.bin
+BENCH_IMGS     ?= $(BENCH_AM_IMG)
+
+bench-img:
+ifneq ($(filter $(BENCH_AM_IMG),$(BENCH_IMGS)),)
+	@$(MAKE) -s -C $(AM_HOME)/bench/micro ARCH=$(GUEST_ISA)-nemu insert-arg mainargs=all
+endif
+
+bench: $(BINARY) bench-img
+	@bash $(NEMU_HOME)/scripts/bench.sh $(BINARY) $(BENCH_RUNS) $(BENCH_RESULT) $(BENCH_BASELINE) $(BENCH_IMGS)
+
+bench-baseline:
+	@test -f $(BENCH_RESULT) || (echo "Run \`make bench' first" && false)
+	cp $(BENCH_RESULT) $(BENCH_BASELINE)
+
+.PHONY: bench bench-img bench-baseline
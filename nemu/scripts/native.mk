@@ -15,6 +15,9 @@
 
 -include $(NEMU_HOME)/../Makefile
 include $(NEMU_HOME)/scripts/build.mk
+ifdef CONFIG_CC_PGO
+include $(NEMU_HOME)/scripts/pgo.mk
+endif
 
 include $(NEMU_HOME)/tools/difftest.mk
 
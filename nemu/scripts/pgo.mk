@@ -0,0 +1,72 @@
+#***************************************************************************************
+# Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+#
+# NEMU is licensed under Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#          http://license.coscl.org.cn/MulanPSL2
+#
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+# EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+# MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+#
+# See the Mulan PSL v2 for more details.
+#**************************************************************************************/
+
+# Profile-guided optimization. NEMU is built with instrumentation into the
+# usual object directory, the training images run in batch mode, and every
+# object is built again with the profile. Both builds share the object
+# paths, which gcc uses to name the profile of each object. The profile is
+# kept until a source file or the configuration changes; `make pgo-clean'
+# drops it to train again.
+#
+# The training images default to the AM image of bench/micro, which needs
+# AM_HOME and a toolchain of the guest ISA. Without them, give your own
+# images by PGO_TRAIN_IMGS="a.bin b.bin".
+PGO_DIR   = $(BUILD_DIR)/pgo-$(NAME)
+PGO_STAMP = $(PGO_DIR)/done
+PGO_TRAIN_IMGS ?= $(BENCH_AM_IMG)
+
+ifeq ($(CC),clang)
+PGO_GEN   = -fprofile-generate=$(PGO_DIR)
+PGO_USE   = -fprofile-use=$(PGO_DIR)/nemu.profdata
+PGO_MERGE = llvm-profdata merge -o $(PGO_DIR)/nemu.profdata $(PGO_DIR)/*.profraw
+else
+# the device threads update the counters as well
+PGO_GEN   = -fprofile-generate=$(PGO_DIR) -fprofile-update=prefer-atomic
+# code not reached by the training keeps the usual optimization
+PGO_USE   = -fprofile-use=$(PGO_DIR) -fprofile-partial-training \
+            -Wno-missing-profile -Wno-coverage-mismatch
+PGO_MERGE = true
+endif
+
+ifeq ($(PGO_STAGE),gen)
+CFLAGS  += $(PGO_GEN)
+LDFLAGS += $(PGO_GEN)
+else
+CFLAGS  += $(PGO_USE)
+LDFLAGS += $(PGO_USE)
+
+$(OBJS): $(PGO_STAMP)
+
+$(PGO_STAMP): $(SRCS) $(NEMU_HOME)/include/config/auto.conf
+	@$(if $(filter $(BENCH_AM_IMG),$(PGO_TRAIN_IMGS)), \
+	  test -n "$(AM_HOME)" || (echo "PGO: AM_HOME is not set, set it with a toolchain of" \
+	    "the guest ISA, or give the training images by PGO_TRAIN_IMGS" && false))
+	@rm -rf $(OBJ_DIR) $(PGO_DIR)
+	@mkdir -p $(PGO_DIR)
+	@$(MAKE) -s bench-img BENCH_IMGS="$(PGO_TRAIN_IMGS)"
+	@$(MAKE) -s PGO_STAGE=gen app
+	@$(foreach img,$(PGO_TRAIN_IMGS), \
+	  echo + PGO $(notdir $(img)) && \
+	  ($(BINARY) -b $(img) > $(PGO_DIR)/$(notdir $(img)).log 2>&1 || \
+	    (echo "$(img) does not hit good trap, see $(PGO_DIR)/$(notdir $(img)).log" && false)) &&) true
+	@$(PGO_MERGE)
+	@rm -rf $(OBJ_DIR)
+	@touch $@
+endif
+
+pgo-clean:
+	-rm -rf $(PGO_DIR)
+
+.PHONY: pgo-clean
@@ -28,11 +28,39 @@
 
 CPU_state cpu = {};
 uint64_t g_nr_guest_inst = 0;
+uint64_t g_intr_check_inst = UINT64_MAX;
 static uint64_t g_timer = 0; // unit: us
 static bool g_print_step = false;
+bool g_exec_silent = false;
+
+#ifdef CONFIG_FUZZ_COVERAGE
+// with a mask of 0, edges go to a dummy byte until the host provides a map
+static uint8_t cov_dummy = 0;
+uint8_t *g_cov_map = &cov_dummy;
+uint32_t g_cov_mask = 0, g_cov_prev = 0;
+#endif
 
 void device_update();
 
+void cpu_check_intr_at(uint64_t inst) {
+  uint64_t cur = __atomic_load_n(&g_intr_check_inst, __ATOMIC_RELAXED);
+  while (inst < cur && !__atomic_compare_exchange_n(&g_intr_check_inst, &cur, inst,
+        false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void check_intr() {
+  // Everything raised from now on lowers the check point again. A source
+  // which is not pending yet, e.g. the timer, sets its own check point
+  // when queried by the ISA.
+  __atomic_store_n(&g_intr_check_inst, UINT64_MAX, __ATOMIC_SEQ_CST);
+  word_t NO = isa_query_intr();
+  if (NO != INTR_EMPTY) {
+    cpu.pc = isa_raise_intr(NO, cpu.pc);
+    // the reference can not see the devices, take it to the same trap
+    IFDEF(CONFIG_DIFFTEST, ref_difftest_raise_intr(NO));
+  }
+}
+
 static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
 #ifdef CONFIG_ITRACE_COND
   if (ITRACE_COND) { log_write("%s\n", _this->logbuf); }
@@ -82,6 +110,7 @@ static void execute(uint64_t n) {
     g_nr_guest_inst ++;
     trace_and_difftest(&s, cpu.pc);
     if (nemu_state.state != NEMU_RUNNING) break;
+    if (unlikely(g_nr_guest_inst >= __atomic_load_n(&g_intr_check_inst, __ATOMIC_RELAXED))) check_intr();
     IFDEF(CONFIG_DEVICE, device_update());
   }
 }
@@ -96,6 +125,11 @@ static void statistic() {
 }
 
 void assert_fail_msg() {
+#if defined(CONFIG_HAS_SERIAL) && !defined(CONFIG_TARGET_AM)
+  // the output of the guest is buffered, and abort() skips the exit handlers
+  void serial_flush_sync();
+  serial_flush_sync();
+#endif
   isa_reg_display();
   statistic();
 }
@@ -130,3 +164,19 @@ void cpu_exec(uint64_t n) {
     case NEMU_QUIT: statistic();
   }
 }
+
+/* Execute at most `n' instructions without printing anything.
+ * This is used when NEMU is embedded into a host program. */
+void cpu_exec_silent(uint64_t n) {
+  switch (nemu_state.state) {
+    case NEMU_END: case NEMU_ABORT: case NEMU_QUIT: return;
+    default: nemu_state.state = NEMU_RUNNING;
+  }
+
+  g_print_step = false;
+  g_exec_silent = true;
+  execute(n);
+  g_exec_silent = false;
+
+  if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+}
@@ -30,7 +30,134 @@ enum {
 static uint8_t *sbuf = NULL;
 static uint32_t *audio_base = NULL;
 
+// sbuf is a ring shared by the guest, which produces samples, and the
+// audio callback, which consumes them on the SDL audio thread. The guest
+// copies samples right after the bytes it has committed before, then
+// commits them by writing the number of new bytes to reg_count. Reading
+// reg_count returns the number of bytes not consumed yet.
+//
+// `produced' is only written by the CPU thread and `consumed' only by
+// the consumer, so neither side takes a lock or waits for the other.
+static uint64_t produced = 0, consumed = 0;
+static bool opened = false;
+static FILE *wav_fp = NULL;
+static uint32_t wav_size = 0;
+
+static uint32_t occupancy() {
+  return produced - __atomic_load_n(&consumed, __ATOMIC_ACQUIRE);
+}
+
+// the part of the ring starting at `pos' with at most `n' bytes without wrapping
+static uint32_t ring_chunk(uint64_t pos, uint32_t n, uint8_t **p) {
+  uint32_t off = pos % CONFIG_SB_SIZE;
+  *p = sbuf + off;
+  return (n < CONFIG_SB_SIZE - off ? n : CONFIG_SB_SIZE - off);
+}
+
+static void audio_play(void *userdata, uint8_t *stream, int len) {
+  uint64_t c = consumed;
+  uint32_t avail = __atomic_load_n(&produced, __ATOMIC_ACQUIRE) - c;
+  uint32_t n = (avail < len ? avail : len);
+  uint32_t done = 0;
+  while (done < n) {
+    uint8_t *p;
+    uint32_t chunk = ring_chunk(c + done, n - done, &p);
+    memcpy(stream + done, p, chunk);
+    done += chunk;
+  }
+  if (len > n) memset(stream + n, 0, len - n);
+  __atomic_store_n(&consumed, c + n, __ATOMIC_RELEASE);
+}
+
+// The WAV backend consumes the samples as soon as they are committed,
+// so the guest never waits for the stream to be played.
+static void wav_write_header() {
+  uint32_t freq = audio_base[reg_freq], channels = audio_base[reg_channels];
+  struct {
+    char riff[4]; uint32_t riff_size; char wave[4];
+    char fmt[4]; uint32_t fmt_size; uint16_t format, channels;
+    uint32_t freq, byte_rate; uint16_t block_align, bits;
+    char data[4]; uint32_t data_size;
+  } __attribute__((packed)) h = {
+    {'R', 'I', 'F', 'F'}, 36 + wav_size, {'W', 'A', 'V', 'E'},
+    {'f', 'm', 't', ' '}, 16, 1, channels,
+    freq, freq * channels * 2, channels * 2, 16,
+    {'d', 'a', 't', 'a'}, wav_size,
+  };
+  rewind(wav_fp);
+  fwrite(&h, sizeof(h), 1, wav_fp);
+  fseek(wav_fp, 0, SEEK_END);
+}
+
+static void wav_close() {
+  wav_write_header();
+  fclose(wav_fp);
+}
+
+static void wav_consume() {
+  uint32_t n = occupancy();
+  while (n > 0) {
+    uint8_t *p;
+    uint32_t chunk = ring_chunk(consumed, n, &p);
+    fwrite(p, 1, chunk, wav_fp);
+    wav_size += chunk;
+    consumed += chunk;
+    n -= chunk;
+  }
+}
+
+static void init_stream() {
+  if (strlen(CONFIG_AUDIO_WAV_PATH) > 0) {
+    if (wav_fp == NULL) {
+      wav_fp = fopen(CONFIG_AUDIO_WAV_PATH, "wb");
+      Assert(wav_fp, "Can not open '%s'", CONFIG_AUDIO_WAV_PATH);
+      atexit(wav_close);
+      Log("Dump audio to %s", CONFIG_AUDIO_WAV_PATH);
+    }
+    wav_write_header();
+    produced = consumed = 0;
+    return;
+  }
+
+  // stop the callback before resetting the ring
+  if (opened) SDL_CloseAudio();
+  produced = consumed = 0;
+  SDL_AudioSpec s = {};
+  s.freq = audio_base[reg_freq];
+  s.format = AUDIO_S16SYS;
+  s.channels = audio_base[reg_channels];
+  s.samples = audio_base[reg_samples];
+  s.callback = audio_play;
+  s.userdata = NULL;
+  opened = (SDL_InitSubSystem(SDL_INIT_AUDIO) == 0 && SDL_OpenAudio(&s, NULL) == 0);
+  if (opened) SDL_PauseAudio(0);
+  else Log("Can not open audio: %s, the samples are dropped", SDL_GetError());
+}
+
+static void commit(uint32_t len) {
+  uint32_t room = CONFIG_SB_SIZE - occupancy();
+  if (len > room) len = room; // overflowing samples are dropped
+  __atomic_store_n(&produced, produced + len, __ATOMIC_RELEASE);
+  if (wav_fp != NULL) wav_consume();
+  // Without a stream nothing consumes the ring, drop the samples at once,
+  // or the guest would wait forever for the room to play the rest.
+  else if (!opened) __atomic_store_n(&consumed, produced, __ATOMIC_RELEASE);
+}
+
 static void audio_io_handler(uint32_t offset, int len, bool is_write) {
+  switch (offset / sizeof(uint32_t)) {
+    case reg_init:
+      if (is_write && audio_base[reg_init] != 0) {
+        init_stream();
+        audio_base[reg_init] = 0;
+      }
+      break;
+    case reg_count:
+      if (is_write) commit(audio_base[reg_count]);
+      audio_base[reg_count] = occupancy();
+      break;
+    default: break;
+  }
 }
 
 void init_audio() {
@@ -41,6 +168,8 @@ void init_audio() {
 #else
   add_mmio_map("audio", CONFIG_AUDIO_CTL_MMIO, audio_base, space_size, audio_io_handler);
 #endif
+  memset(audio_base, 0, space_size);
+  audio_base[reg_sbuf_size] = CONFIG_SB_SIZE;
 
   sbuf = (uint8_t *)new_space(CONFIG_SB_SIZE);
   add_mmio_map("audio-sbuf", CONFIG_SB_ADDR, sbuf, CONFIG_SB_SIZE, NULL);
@@ -0,0 +1,88 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <device/map.h>
+#include <device/intr.h>
+#include <cpu/cpu.h>
+
+// The CLINT of a single hart. mtime is driven by the number of guest
+// instructions instead of the host time, so the timer interrupts arrive
+// at the same instruction in every run. Writing mtimecmp sets the check
+// point of interrupts to the instruction where mtime reaches it, so
+// nothing is done by the instructions in between.
+
+#define CLINT_MSIP     0x0000
+#define CLINT_MTIMECMP 0x4000
+#define CLINT_MTIME    0xbff8
+#define CLINT_SIZE     0x10000
+
+extern uint64_t g_nr_guest_inst;
+
+static uint8_t *clint_base = NULL;
+static uint64_t mtimecmp = UINT64_MAX;
+static uint64_t mtime_offset = 0;
+
+static uint64_t mtime() {
+  return g_nr_guest_inst / CONFIG_CLINT_TICK_INST + mtime_offset;
+}
+
+static void set_timer_check() {
+  uint64_t now = mtime();
+  if (mtimecmp <= now) { cpu_check_intr(); return; }
+  // the instruction count where mtime reaches mtimecmp
+  uint64_t ticks = mtimecmp - mtime_offset;
+  if (ticks > UINT64_MAX / CONFIG_CLINT_TICK_INST) return;
+  cpu_check_intr_at(ticks * CONFIG_CLINT_TICK_INST);
+}
+
+// a 64-bit register may be written by halves
+static uint64_t written(uint64_t old, uint32_t reg, uint32_t offset, int len) {
+  if (len == 8) return *(uint64_t *)(clint_base + reg);
+  uint64_t data = *(uint32_t *)(clint_base + (offset & ~0x3));
+  return (offset - reg < 4 ? (old & ~0xffffffffull) | data : (old & 0xffffffffull) | (data << 32));
+}
+
+static void clint_io_handler(uint32_t offset, int len, bool is_write) {
+  if (offset >= CLINT_MTIME && offset < CLINT_MTIME + 8) {
+    if (is_write) {
+      mtime_offset = written(mtime(), CLINT_MTIME, offset, len) - g_nr_guest_inst / CONFIG_CLINT_TICK_INST;
+      set_timer_check();
+    }
+    *(uint64_t *)(clint_base + CLINT_MTIME) = mtime();
+  } else if (offset >= CLINT_MTIMECMP && offset < CLINT_MTIMECMP + 8) {
+    if (is_write) {
+      mtimecmp = written(mtimecmp, CLINT_MTIMECMP, offset, len);
+      set_timer_check();
+    }
+    *(uint64_t *)(clint_base + CLINT_MTIMECMP) = mtimecmp;
+  } else if (offset < CLINT_MSIP + 4 && is_write) {
+    *(uint32_t *)(clint_base + CLINT_MSIP) &= 1;
+    cpu_check_intr();
+  }
+}
+
+uint32_t clint_query() {
+  uint32_t lines = (*(uint32_t *)(clint_base + CLINT_MSIP) & 1 ? INTR_LINE_SOFT : 0);
+  if (mtime() >= mtimecmp) lines |= INTR_LINE_TIMER;
+  else set_timer_check(); // not yet, check again when it is
+  return lines;
+}
+
+void init_clint() {
+  clint_base = new_space(CLINT_SIZE);
+  memset(clint_base, 0, CLINT_SIZE);
+  *(uint64_t *)(clint_base + CLINT_MTIMECMP) = mtimecmp;
+  add_mmio_map("clint", CONFIG_CLINT_MMIO, clint_base, CLINT_SIZE, clint_io_handler);
+}
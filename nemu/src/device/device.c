@@ -23,32 +23,43 @@
 void init_map();
 void init_serial();
 void init_timer();
+void init_clint();
+void init_plic();
 void init_vga();
 void init_i8042();
 void init_audio();
 void init_disk();
 void init_sdcard();
+void init_virtio();
 void init_alarm();
 
 void send_key(uint8_t, bool);
+bool key_queue_has_room();
+void key_queue_clear();
 void vga_update_screen();
-
-void device_update() {
-  static uint64_t last = 0;
-  uint64_t now = get_time();
-  if (now - last < 1000000 / TIMER_HZ) {
-    return;
-  }
-  last = now;
-
-  IFDEF(CONFIG_HAS_VGA, vga_update_screen());
+void serial_flush();
+void virtio_poll();
 
 #ifndef CONFIG_TARGET_AM
+static bool quit_requested = false;
+
+// SDL events can only be polled by the thread owning the window, which is
+// the render thread of VGA, so the CPU thread never calls SDL_PollEvent().
+// Without CONFIG_VGA_SHOW_SCREEN there is no such thread, and no event is
+// polled at all.
+void device_poll_events() {
   SDL_Event event;
-  while (SDL_PollEvent(&event)) {
+  // Leave the key events in SDL while the key queue is full, until the
+  // guest catches up. Quitting is never held back, but SDL_PeepEvents()
+  // only sees the queue, so it must be filled first.
+  SDL_PumpEvents();
+  if (SDL_PeepEvents(&event, 1, SDL_GETEVENT, SDL_QUIT, SDL_QUIT) > 0) {
+    __atomic_store_n(&quit_requested, true, __ATOMIC_RELEASE);
+  }
+  while (MUXDEF(CONFIG_HAS_KEYBOARD, key_queue_has_room(), true) && SDL_PollEvent(&event)) {
     switch (event.type) {
       case SDL_QUIT:
-        nemu_state.state = NEMU_QUIT;
+        __atomic_store_n(&quit_requested, true, __ATOMIC_RELEASE);
         break;
 #ifdef CONFIG_HAS_KEYBOARD
       // If a key was pressed
@@ -63,13 +74,33 @@ void device_update() {
       default: break;
     }
   }
+}
+#endif
+
+void device_update() {
+  static uint64_t last = 0;
+  uint64_t now = get_time();
+  if (now - last < 1000000 / TIMER_HZ) {
+    return;
+  }
+  last = now;
+
+  IFDEF(CONFIG_HAS_VGA, vga_update_screen());
+
+#ifndef CONFIG_TARGET_AM
+  IFDEF(CONFIG_HAS_SERIAL, serial_flush());
+  IFDEF(CONFIG_HAS_VIRTIO, virtio_poll());
+  if (__atomic_load_n(&quit_requested, __ATOMIC_ACQUIRE)) {
+    nemu_state.state = NEMU_QUIT;
+  }
 #endif
 }
 
+// Keys pressed while NEMU is stopped are already dropped by send_key(),
+// drop the keys not read by the guest as well.
 void sdl_clear_event_queue() {
 #ifndef CONFIG_TARGET_AM
-  SDL_Event event;
-  while (SDL_PollEvent(&event));
+  IFDEF(CONFIG_HAS_KEYBOARD, key_queue_clear());
 #endif
 }
 
@@ -79,11 +110,14 @@ void init_device() {
 
   IFDEF(CONFIG_HAS_SERIAL, init_serial());
   IFDEF(CONFIG_HAS_TIMER, init_timer());
+  IFDEF(CONFIG_HAS_CLINT, init_clint());
+  IFDEF(CONFIG_HAS_PLIC, init_plic());
   IFDEF(CONFIG_HAS_VGA, init_vga());
   IFDEF(CONFIG_HAS_KEYBOARD, init_i8042());
   IFDEF(CONFIG_HAS_AUDIO, init_audio());
   IFDEF(CONFIG_HAS_DISK, init_disk());
   IFDEF(CONFIG_HAS_SDCARD, init_sdcard());
+  IFDEF(CONFIG_HAS_VIRTIO, init_virtio());
 
   IFNDEF(CONFIG_TARGET_AM, init_alarm());
 }
@@ -14,6 +14,96 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <memory/paddr.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BLKSZ 512
+
+// The guest sets the buffer and the blocks, then starts a transfer by
+// writing reg_cmd. The whole transfer is done at once as a memcpy()
+// between pmem and the image mapped into NEMU, so the device is always
+// ready when the guest looks at reg_status.
+enum {
+  reg_present,
+  reg_blksz,
+  reg_blkcnt,
+  reg_status,
+  reg_buf_lo,
+  reg_buf_hi,
+  reg_blkno,
+  reg_nblk,
+  reg_cmd,
+  nr_reg
+};
+
+enum { CMD_READ = 1, CMD_WRITE };
+
+static uint32_t *disk_base = NULL;
+static uint8_t *img = NULL;
+static uint64_t nr_blk = 0;
+
+static void disk_dma(bool is_write) {
+  uint64_t addr = ((uint64_t)disk_base[reg_buf_hi] << 32) | disk_base[reg_buf_lo];
+  // reg_buf_hi must be 0 when paddr_t is 32-bit, instead of being truncated
+  Assert(addr == (paddr_t)addr, "buffer at 0x%" PRIx64 " is out of the physical address space", addr);
+  paddr_t buf = addr;
+  uint64_t blkno = disk_base[reg_blkno], nblk = disk_base[reg_nblk];
+  uint64_t size = nblk * BLKSZ;
+  if (nblk == 0) return;
+  Assert(blkno + nblk <= nr_blk, "blocks [%" PRIu64 ", %" PRIu64 ") are out of the disk of %" PRIu64 " blocks",
+      blkno, blkno + nblk, nr_blk);
+  Assert(in_pmem(buf) && size <= CONFIG_MSIZE - (buf - CONFIG_MBASE),
+      "buffer at " FMT_PADDR " with %" PRIu64 " bytes is out of pmem", buf, size);
+  uint8_t *disk = img + blkno * BLKSZ;
+  uint8_t *mem = guest_to_host(buf);
+  if (is_write) memcpy(disk, mem, size);
+  else memcpy(mem, disk, size);
+}
+
+static void disk_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write || offset / sizeof(uint32_t) != reg_cmd) return;
+  switch (disk_base[reg_cmd]) {
+    case CMD_READ: disk_dma(false); break;
+    case CMD_WRITE: disk_dma(true); break;
+    default: panic("unsupported disk command = %d", disk_base[reg_cmd]);
+  }
+}
+
+static void load_disk_img(const char *path) {
+  int fd = open(path, O_RDWR);
+  bool writable = (fd >= 0);
+  if (!writable) fd = open(path, O_RDONLY);
+  if (fd < 0) { Log("Can not find disk image: %s", path); return; }
+  struct stat st;
+  Assert(fstat(fd, &st) == 0, "Can not stat disk image: %s", path);
+  nr_blk = st.st_size / BLKSZ;
+  if (nr_blk > 0) {
+    // a read-only image is mapped privately so that writes are kept in NEMU
+    img = mmap(NULL, nr_blk * BLKSZ, PROT_READ | PROT_WRITE,
+        (writable ? MAP_SHARED : MAP_PRIVATE), fd, 0);
+    Assert(img != MAP_FAILED, "Can not map disk image: %s", path);
+  }
+  close(fd);
+  Log("Disk image %s, %" PRIu64 " blocks%s", path, nr_blk, (writable ? "" : ", read-only"));
+}
 
 void init_disk() {
+  uint32_t space_size = sizeof(uint32_t) * nr_reg;
+  disk_base = (uint32_t *)new_space(space_size);
+#ifdef CONFIG_HAS_PORT_IO
+  add_pio_map ("disk", CONFIG_DISK_CTL_PORT, disk_base, space_size, disk_io_handler);
+#else
+  add_mmio_map("disk", CONFIG_DISK_CTL_MMIO, disk_base, space_size, disk_io_handler);
+#endif
+  memset(disk_base, 0, space_size);
+
+  const char *path = CONFIG_DISK_IMG_PATH;
+  if (path[0] != '\0') load_disk_img(path);
+  disk_base[reg_present] = (nr_blk > 0);
+  disk_base[reg_blksz] = BLKSZ;
+  disk_base[reg_blkcnt] = nr_blk;
+  disk_base[reg_status] = 1;
 }
@@ -13,7 +13,24 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
-#include <isa.h>
+#include <device/intr.h>
 
-void dev_raise_intr() {
+void plic_raise(int irq);
+void plic_set_level(int irq, bool (*level)());
+bool plic_query();
+uint32_t clint_query();
+
+void dev_raise_intr(int irq) {
+  IFDEF(CONFIG_HAS_PLIC, plic_raise(irq));
+}
+
+void dev_set_intr_level(int irq, bool (*level)()) {
+  IFDEF(CONFIG_HAS_PLIC, plic_set_level(irq, level));
+}
+
+uint32_t dev_query_intr() {
+  uint32_t lines = 0;
+  IFDEF(CONFIG_HAS_CLINT, lines |= clint_query());
+  IFDEF(CONFIG_HAS_PLIC, lines |= (plic_query() ? INTR_LINE_EXTERNAL : 0));
+  return lines;
 }
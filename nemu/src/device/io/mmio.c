@@ -61,3 +61,18 @@ word_t mmio_read(paddr_t addr, int len) {
 void mmio_write(paddr_t addr, int len, word_t data) {
   map_write(addr, len, data, fetch_mmio_map(addr));
 }
+
+#define def_mmio_rw(bits) \
+  word_t concat(mmio_read, bits)(paddr_t addr) { \
+    return map_read(addr, bits / 8, fetch_mmio_map(addr)); \
+  } \
+  void concat(mmio_write, bits)(paddr_t addr, word_t data) { \
+    map_write(addr, bits / 8, data, fetch_mmio_map(addr)); \
+  }
+
+def_mmio_rw(8)
+def_mmio_rw(16)
+def_mmio_rw(32)
+#ifdef CONFIG_ISA64
+def_mmio_rw(64)
+#endif
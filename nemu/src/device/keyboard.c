@@ -45,31 +45,124 @@ static void init_keymap() {
   MAP(NEMU_KEYS, SDL_KEYMAP)
 }
 
+// Keys are produced by the thread polling SDL events and consumed by the
+// CPU thread. Each side only writes its own index, so neither takes a lock.
+// The producer checks key_queue_has_room() before taking an event from SDL.
 #define KEY_QUEUE_LEN 1024
-static int key_queue[KEY_QUEUE_LEN] = {};
-static int key_f = 0, key_r = 0;
+static uint32_t key_queue[KEY_QUEUE_LEN] = {};
+static uint32_t key_f = 0, key_r = 0;
+
+bool key_queue_has_room() {
+  return key_r - __atomic_load_n(&key_f, __ATOMIC_ACQUIRE) < KEY_QUEUE_LEN;
+}
+
+void key_queue_clear() {
+  __atomic_store_n(&key_f, __atomic_load_n(&key_r, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
 
 static void key_enqueue(uint32_t am_scancode) {
-  key_queue[key_r] = am_scancode;
-  key_r = (key_r + 1) % KEY_QUEUE_LEN;
-  Assert(key_r != key_f, "key queue overflow!");
+  if (!key_queue_has_room()) return;
+  key_queue[key_r % KEY_QUEUE_LEN] = am_scancode;
+  __atomic_store_n(&key_r, key_r + 1, __ATOMIC_RELEASE);
 }
 
 static uint32_t key_dequeue() {
   uint32_t key = NEMU_KEY_NONE;
-  if (key_f != key_r) {
-    key = key_queue[key_f];
-    key_f = (key_f + 1) % KEY_QUEUE_LEN;
+  if (key_f != __atomic_load_n(&key_r, __ATOMIC_ACQUIRE)) {
+    key = key_queue[key_f % KEY_QUEUE_LEN];
+    __atomic_store_n(&key_f, key_f + 1, __ATOMIC_RELEASE);
   }
   return key;
 }
 
+static bool replaying = false;
+
 void send_key(uint8_t scancode, bool is_keydown) {
+  // the keys only come from the script when replaying
+  if (replaying) return;
   if (nemu_state.state == NEMU_RUNNING && keymap[scancode] != NEMU_KEY_NONE) {
     uint32_t am_scancode = keymap[scancode] | (is_keydown ? KEYDOWN_MASK : 0);
     key_enqueue(am_scancode);
   }
 }
+
+// A script has one key per line, "<instruction count> <down|up> <key>",
+// e.g. "1234567 down A" with the names in NEMU_KEYS. Recording writes the
+// keys read by the guest with the instruction count at the read. When
+// replaying, a key is put into the queue right before the first read of
+// the data port at or after its instruction count, so the guest reads
+// every key at the same instruction as in the recorded run.
+typedef struct {
+  uint64_t inst;
+  uint32_t am_scancode;
+} KeyEvent;
+
+#define NEMU_KEY_STR(k) [NEMU_KEY_ ## k] = #k,
+static const char *key_names[] = { MAP(NEMU_KEYS, NEMU_KEY_STR) };
+
+static FILE *record_fp = NULL;
+static KeyEvent *script = NULL;
+static int nr_script = 0, script_idx = 0;
+
+static uint32_t key_by_name(const char *name) {
+  for (int i = 0; i < ARRLEN(key_names); i ++) {
+    if (key_names[i] != NULL && strcmp(key_names[i], name) == 0) return i;
+  }
+  return NEMU_KEY_NONE;
+}
+
+static void load_script(const char *path) {
+  FILE *fp = fopen(path, "r");
+  Assert(fp, "Can not open '%s'", path);
+  int cap = 64;
+  script = malloc(sizeof(KeyEvent) * cap);
+  char line[128];
+  int lineno = 0;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    lineno ++;
+    uint64_t inst;
+    char action[8], name[32];
+    if (line[0] == '#' || sscanf(line, "%" SCNu64 " %7s %31s", &inst, action, name) != 3) continue;
+    uint32_t key = key_by_name(name);
+    Assert(key != NEMU_KEY_NONE, "%s:%d: unknown key '%s'", path, lineno, name);
+    Assert(strcmp(action, "down") == 0 || strcmp(action, "up") == 0,
+        "%s:%d: expect 'down' or 'up'", path, lineno);
+    Assert(nr_script == 0 || inst >= script[nr_script - 1].inst,
+        "%s:%d: instruction count goes backward", path, lineno);
+    if (nr_script == cap) { cap *= 2; script = realloc(script, sizeof(KeyEvent) * cap); }
+    script[nr_script ++] = (KeyEvent) { .inst = inst,
+      .am_scancode = key | (strcmp(action, "down") == 0 ? KEYDOWN_MASK : 0) };
+  }
+  fclose(fp);
+  replaying = true;
+  Log("Replay %d keys from %s", nr_script, path);
+}
+
+static void replay_keys() {
+  extern uint64_t g_nr_guest_inst;
+  while (script_idx < nr_script && script[script_idx].inst <= g_nr_guest_inst && key_queue_has_room()) {
+    key_enqueue(script[script_idx ++].am_scancode);
+  }
+}
+
+static void record_key(uint32_t am_scancode) {
+  extern uint64_t g_nr_guest_inst;
+  fprintf(record_fp, "%" PRIu64 " %s %s\n", g_nr_guest_inst,
+      (am_scancode & KEYDOWN_MASK ? "down" : "up"), key_names[am_scancode & ~KEYDOWN_MASK]);
+  // keys are rare, keep the record even if NEMU aborts
+  fflush(record_fp);
+}
+
+static void init_replay() {
+  const char *replay_path = CONFIG_KEYBOARD_REPLAY_PATH;
+  const char *record_path = CONFIG_KEYBOARD_RECORD_PATH;
+  if (replay_path[0] != '\0') load_script(replay_path);
+  if (record_path[0] != '\0') {
+    record_fp = fopen(record_path, "w");
+    Assert(record_fp, "Can not open '%s'", record_path);
+    Log("Record keys to %s", record_path);
+  }
+}
 #else // !CONFIG_TARGET_AM
 #define NEMU_KEY_NONE 0
 
@@ -85,7 +178,14 @@ static uint32_t *i8042_data_port_base = NULL;
 static void i8042_data_io_handler(uint32_t offset, int len, bool is_write) {
   assert(!is_write);
   assert(offset == 0);
+#ifndef CONFIG_TARGET_AM
+  if (replaying) replay_keys();
+  uint32_t key = key_dequeue();
+  if (record_fp != NULL && key != NEMU_KEY_NONE) record_key(key);
+  i8042_data_port_base[0] = key;
+#else
   i8042_data_port_base[0] = key_dequeue();
+#endif
 }
 
 void init_i8042() {
@@ -97,4 +197,5 @@ void init_i8042() {
   add_mmio_map("keyboard", CONFIG_I8042_DATA_MMIO, i8042_data_port_base, 4, i8042_data_io_handler);
 #endif
   IFNDEF(CONFIG_TARGET_AM, init_keymap());
+  IFNDEF(CONFIG_TARGET_AM, init_replay());
 }
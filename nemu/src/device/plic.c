@@ -0,0 +1,88 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <device/map.h>
+#include <device/intr.h>
+#include <cpu/cpu.h>
+
+// The PLIC with the M-mode context of a single hart. Devices make sources
+// pending from any thread with dev_raise_intr(), which also makes the CPU
+// check interrupts at the next instruction. Sources are edge triggered, but
+// a completed source with a level callback is pending again while the
+// device still has work.
+
+#define PLIC_PRIORITY  0x000000
+#define PLIC_PENDING   0x001000
+#define PLIC_ENABLE    0x002000
+#define PLIC_THRESHOLD 0x200000
+#define PLIC_CLAIM     0x200004
+#define PLIC_SIZE      0x200008
+
+static uint8_t *plic_base = NULL;
+static uint32_t pending = 0;
+static bool (*level[NR_IRQ])() = {};
+
+#define reg(offset) (*(uint32_t *)(plic_base + (offset)))
+
+// the pending and enabled source with the highest priority over the threshold
+static int plic_best() {
+  uint32_t p = __atomic_load_n(&pending, __ATOMIC_ACQUIRE) & reg(PLIC_ENABLE);
+  uint32_t max = reg(PLIC_THRESHOLD);
+  int best = 0;
+  for (int irq = 1; irq < NR_IRQ; irq ++) {
+    uint32_t prio = reg(PLIC_PRIORITY + irq * 4);
+    if ((p >> irq & 1) && prio > max) { max = prio; best = irq; }
+  }
+  return best;
+}
+
+void plic_raise(int irq) {
+  assert(irq > 0 && irq < NR_IRQ);
+  __atomic_or_fetch(&pending, 1u << irq, __ATOMIC_ACQ_REL);
+  cpu_check_intr();
+}
+
+static void plic_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write) {
+    if (offset == PLIC_PENDING) reg(PLIC_PENDING) = __atomic_load_n(&pending, __ATOMIC_ACQUIRE);
+    else if (offset == PLIC_CLAIM) {
+      int irq = plic_best();
+      __atomic_and_fetch(&pending, ~(1u << irq), __ATOMIC_ACQ_REL);
+      reg(PLIC_CLAIM) = irq;
+    }
+    return;
+  }
+  if (offset == PLIC_CLAIM) {
+    uint32_t irq = reg(PLIC_CLAIM);
+    if (irq > 0 && irq < NR_IRQ && level[irq] != NULL && level[irq]()) plic_raise(irq);
+  }
+  // Sources may be enabled or completed, or the threshold may be lowered.
+  cpu_check_intr();
+}
+
+void plic_set_level(int irq, bool (*fn)()) {
+  assert(irq > 0 && irq < NR_IRQ);
+  level[irq] = fn;
+}
+
+bool plic_query() {
+  return plic_best() != 0;
+}
+
+void init_plic() {
+  plic_base = new_space(PLIC_SIZE);
+  memset(plic_base, 0, PLIC_SIZE);
+  add_mmio_map("plic", CONFIG_PLIC_MMIO, plic_base, PLIC_SIZE, plic_io_handler);
+}
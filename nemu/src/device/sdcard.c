@@ -14,6 +14,12 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <device/intr.h>
+#include <memory/paddr.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "mmc.h"
 
 // http://www.files.e-shop.co.il/pdastore/Tech-mmc-samsung/SEC%20MMC%20SPEC%20ver09.pdf
@@ -28,8 +34,15 @@
 #define C_SIZE (NR_BLOCK / MULT - 1)
 
 // This is a simple hardware implementation of linux/drivers/mmc/host/bcm2835.c
-// No DMA and IRQ is supported, so the driver must be modified to start PIO
-// right after sending the actual read/write commands.
+// The DMA engine of bcm2835 is not modeled, so the driver must be modified
+// to start PIO right after sending the actual read/write commands, or to use
+// the DMA registers below, which are an extension of NEMU.
+//
+// DMA: after a read/write command, set SDDMALO/SDDMAHI to the guest physical
+// address of the buffer and write 1 to SDDMACTL. All SDHBLC blocks are copied
+// at once between the card image and pmem, then SDHSTS_BLOCK_IRPT is set and
+// an interrupt is raised if SDHCFG_BLOCK_IRPT_EN is set. SDHSTS is cleared by
+// writing 1 to its bits.
 
 enum {
   SDCMD, SDARG, SDTOUT, SDCDIV,
@@ -37,24 +50,56 @@ enum {
   SDHSTS, __PAD0, __PAD1, __PAD2,
   SDVDD, SDEDM, SDHCFG, SDHBCT,
   SDDATA, __PAD10, __PAD11, __PAD12,
-  SDHBLC
+  SDHBLC,
+  SDDMALO, SDDMAHI, SDDMACTL
 };
 
-static FILE *fp = NULL;
+#define SDHSTS_BLOCK_IRPT    0x200
+#define SDHCFG_BLOCK_IRPT_EN (1 << 8)
+#define BLKSZ 512
+
+static uint8_t *img = NULL;
+static uint64_t img_size = 0;
 static uint32_t *base = NULL;
 static uint32_t blkcnt = 0;
 static long blk_addr = 0;
 static uint32_t addr = 0;
 static bool write_cmd = 0;
 static bool read_ext_csd = false;
+static uint32_t hsts = 0;
 
 static void prepare_rw(int is_write) {
   blk_addr = base[SDARG];
   addr = 0;
-  if (fp) fseek(fp, blk_addr << 9, SEEK_SET);
   write_cmd = is_write;
 }
 
+// the part of the transfer at `addr' inside the image, NULL if outside
+static uint8_t* img_at(uint64_t len) {
+  uint64_t pos = ((uint64_t)blk_addr << 9) + addr;
+  if (img == NULL || pos > img_size || len > img_size - pos) return NULL;
+  return img + pos;
+}
+
+static void sdcard_dma() {
+  uint64_t dma = ((uint64_t)base[SDDMAHI] << 32) | base[SDDMALO];
+  // SDDMAHI must be 0 when paddr_t is 32-bit, instead of being truncated
+  Assert(dma == (paddr_t)dma, "buffer at 0x%" PRIx64 " is out of the physical address space", dma);
+  paddr_t buf = dma;
+  uint64_t nblk = (base[SDHBLC] != 0 ? base[SDHBLC] : blkcnt);
+  uint64_t size = nblk * BLKSZ;
+  uint8_t *card = img_at(size);
+  Assert(card != NULL, "blocks [%ld, %ld) are out of the sdcard image", blk_addr, blk_addr + (long)nblk);
+  Assert(in_pmem(buf) && size <= CONFIG_MSIZE - (buf - CONFIG_MBASE),
+      "buffer at " FMT_PADDR " with %" PRIu64 " bytes is out of pmem", buf, size);
+  if (write_cmd) memcpy(card, guest_to_host(buf), size);
+  else memcpy(guest_to_host(buf), card, size);
+  addr += size;
+
+  hsts |= SDHSTS_BLOCK_IRPT;
+  if (base[SDHCFG] & SDHCFG_BLOCK_IRPT_EN) dev_raise_intr(IRQ_SDCARD);
+}
+
 static void sdcard_handle_cmd(int cmd) {
   switch (cmd) {
     case MMC_GO_IDLE_STATE: break;
@@ -109,26 +154,53 @@ static void sdcard_io_handler(uint32_t offset, int len, bool is_write) {
          }
          base[SDDATA] = data;
          if (addr == 512 - 4) read_ext_csd = false;
-       } else if (fp) {
-         __attribute__((unused)) int ret;
-         if (!write_cmd) { ret = fread(&base[SDDATA], 4, 1, fp); }
-         else { ret = fwrite(&base[SDDATA], 4, 1, fp); }
+       } else {
+         uint8_t *p = img_at(4);
+         if (p == NULL) { if (!write_cmd) base[SDDATA] = 0; }
+         else if (!write_cmd) { memcpy(&base[SDDATA], p, 4); }
+         else { memcpy(p, &base[SDDATA], 4); }
        }
        addr += 4;
        break;
+    case SDHSTS:
+      if (is_write) hsts &= ~base[SDHSTS];
+      base[SDHSTS] = hsts;
+      break;
+    case SDHCFG:
+    case SDHBLC:
+    case SDDMALO:
+    case SDDMAHI:
+      break;
+    case SDDMACTL:
+      if (is_write && (base[SDDMACTL] & 1)) sdcard_dma();
+      base[SDDMACTL] = 0;
+      break;
     default:
       Log("offset = 0x%x(idx = %d), is_write = %d, data = 0x%x", offset, idx, is_write, base[idx]);
       panic("unhandle offset = %d", offset);
   }
 }
 
+static bool sdcard_intr_level() {
+  return (hsts & SDHSTS_BLOCK_IRPT) && (base[SDHCFG] & SDHCFG_BLOCK_IRPT_EN);
+}
+
 void init_sdcard() {
   base = (uint32_t *)new_space(0x80);
   add_mmio_map("sdhci", CONFIG_SDCARD_CTL_MMIO, base, 0x80, sdcard_io_handler);
+  dev_set_intr_level(IRQ_SDCARD, sdcard_intr_level);
 
   Assert(C_SIZE < (1 << 12), "shoule be fit in 12 bits");
 
-  const char *img = CONFIG_SDCARD_IMG_PATH;
-  fp = fopen(img, "r+");
-  if (fp == NULL) Log("Can not find sdcard image: %s", img);
+  const char *path = CONFIG_SDCARD_IMG_PATH;
+  int fd = open(path, O_RDWR);
+  if (fd < 0) { Log("Can not find sdcard image: %s", path); return; }
+  struct stat st;
+  Assert(fstat(fd, &st) == 0, "Can not stat sdcard image: %s", path);
+  img_size = st.st_size;
+  if (img_size > 0) {
+    img = mmap(NULL, img_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    Assert(img != MAP_FAILED, "Can not map sdcard image: %s", path);
+  }
+  close(fd);
 }
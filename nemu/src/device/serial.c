@@ -13,33 +13,369 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
+#define _GNU_SOURCE // posix_openpt() and friends
 #include <utils.h>
 #include <device/map.h>
+#include <device/intr.h>
 
 /* http://en.wikibooks.org/wiki/Serial_Programming/8250_UART_Programming */
 // NOTE: this is compatible to 16550
 
-#define CH_OFFSET 0
+#define CH_OFFSET  0
+#define IER_OFFSET 1
+#define IIR_OFFSET 2 // FCR when written
+#define LCR_OFFSET 3
+#define MCR_OFFSET 4
+#define LSR_OFFSET 5
+#define MSR_OFFSET 6
+#define SCR_OFFSET 7
+
+#define IER_ERBFI 0x01 // enable received data available interrupt
+#define IER_ETBEI 0x02 // enable transmitter holding register empty interrupt
+// The THRE interrupt is not implemented, and ETBEI reads back as 0,
+// so the drivers notice it and poll the transmitter instead.
+#define IER_MASK  (0x0f & ~IER_ETBEI)
+#define IIR_NO_INT 0xc1
+#define IIR_RDA    0xc4 // received data available
+#define LCR_DLAB 0x80 // divisor latch access bit
+#define LSR_DR   0x01 // data ready
+#define LSR_THRE 0x20 // transmitter holding register empty
+#define LSR_TEMT 0x40 // transmitter empty
+#define MSR_CTS  0x10 // clear to send
+#define MSR_DSR  0x20 // data set ready
+#define MSR_DCD  0x80 // data carrier detect
 
 static uint8_t *serial_base = NULL;
+// Offset 0 and 1 access the divisor latch instead of the data register
+// and IER while LCR.DLAB is set, so IER is kept out of the space.
+static uint8_t ier = 0;
+static uint8_t dll = 0, dlm = 0;
+
+#ifdef CONFIG_TARGET_AM
+static void serial_putc(char ch) {
+  putch(ch);
+}
+
+static bool serial_rx_ready() { return false; }
+static uint8_t serial_getc() { return 0; }
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// The output is buffered and written to the host stderr, or the console,
+// on newline, when the buffer is full, on device update and on exit,
+// instead of one syscall per byte.
+#define OBUF_SIZE 4096
+
+static char obuf[2][OBUF_SIZE];
+static int obuf_cur = 0, obuf_len = 0;
+// -1 if the output is dropped, changed by the console thread
+static int out_fd = STDERR_FILENO;
+
+static void write_all(const char *p, int n) {
+  int fd = __atomic_load_n(&out_fd, __ATOMIC_ACQUIRE);
+  while (n > 0 && fd >= 0) {
+    ssize_t ret = write(fd, p, n);
+    if (ret <= 0) return;
+    p += ret;
+    n -= ret;
+  }
+}
+
+#ifdef CONFIG_SERIAL_OUTPUT_THREAD
+#include <errno.h>
+#include <pthread.h>
+
+// A full buffer is handed over to the writer thread and the other one is
+// filled meanwhile. The CPU thread only waits if the writer is still busy
+// with the previous buffer.
+static const char *pending = NULL;
+static int pending_len = 0;
+static bool writer_done = false;
+static pthread_t writer;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+
+static void* writer_thread(void *arg) {
+  pthread_mutex_lock(&writer_lock);
+  while (true) {
+    while (pending_len == 0 && !writer_done) pthread_cond_wait(&writer_cond, &writer_lock);
+    if (pending_len == 0) break;
+    pthread_mutex_unlock(&writer_lock);
+    write_all(pending, pending_len);
+    pthread_mutex_lock(&writer_lock);
+    pending_len = 0;
+    pthread_cond_broadcast(&writer_cond);
+  }
+  pthread_mutex_unlock(&writer_lock);
+  return NULL;
+}
+
+static void flush_output(const char *p, int n) {
+  pthread_mutex_lock(&writer_lock);
+  while (pending_len != 0) pthread_cond_wait(&writer_cond, &writer_lock);
+  pending = p;
+  pending_len = n;
+  pthread_cond_broadcast(&writer_cond);
+  pthread_mutex_unlock(&writer_lock);
+}
+#else
+static void flush_output(const char *p, int n) {
+  write_all(p, n);
+}
+#endif
+
+void serial_flush() {
+  if (obuf_len == 0) return;
+  flush_output(obuf[obuf_cur], obuf_len);
+  // with the writer thread, the buffer just flushed is still being written
+  obuf_cur ^= 1;
+  obuf_len = 0;
+}
+
+static void serial_exit() {
+  serial_flush();
+#ifdef CONFIG_SERIAL_OUTPUT_THREAD
+  pthread_mutex_lock(&writer_lock);
+  writer_done = true;
+  pthread_cond_broadcast(&writer_cond);
+  pthread_mutex_unlock(&writer_lock);
+  pthread_join(writer, NULL);
+#endif
+}
 
+// Called on the fatal path, where abort() skips serial_exit(). The output
+// before a panic is the most wanted, so it is written by the caller.
+void serial_flush_sync() {
+#ifdef CONFIG_SERIAL_OUTPUT_THREAD
+  // give the writer a moment with the buffer it holds, it may never finish
+  // if the panic comes from the writer itself
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += 100000000;
+  if (ts.tv_nsec >= 1000000000) { ts.tv_sec ++; ts.tv_nsec -= 1000000000; }
+  pthread_mutex_lock(&writer_lock);
+  int ret = 0;
+  while (pending_len != 0 && ret != ETIMEDOUT) ret = pthread_cond_timedwait(&writer_cond, &writer_lock, &ts);
+  if (pending_len != 0) write_all(pending, pending_len);
+  pending_len = 0;
+  pthread_mutex_unlock(&writer_lock);
+#endif
+  write_all(obuf[obuf_cur], obuf_len);
+  obuf_len = 0;
+}
 
 static void serial_putc(char ch) {
-  MUXDEF(CONFIG_TARGET_AM, putch(ch), putc(ch, stderr));
+  obuf[obuf_cur][obuf_len ++] = ch;
+  if (ch == '\n' || obuf_len == OBUF_SIZE) serial_flush();
+}
+
+#ifdef CONFIG_SERIAL_CONSOLE
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// The console is a pseudo terminal or a Unix socket. A thread waits for
+// input with epoll and fills the RX ring, so the CPU never polls the host.
+// The ring has one producer (the console thread) and one consumer (the
+// CPU thread), each owning one index, so no lock is needed.
+#define RX_RING_SIZE 4096
+
+static uint8_t rx_ring[RX_RING_SIZE];
+static uint32_t rx_head = 0, rx_tail = 0;
+static int console_fd = -1, listen_fd = -1;
+
+static bool serial_rx_ready() {
+  return rx_head != __atomic_load_n(&rx_tail, __ATOMIC_ACQUIRE);
+}
+
+static uint8_t serial_getc() {
+  if (!serial_rx_ready()) return 0;
+  uint8_t ch = rx_ring[rx_head % RX_RING_SIZE];
+  __atomic_store_n(&rx_head, rx_head + 1, __ATOMIC_RELEASE);
+  return ch;
+}
+
+// return false if the peer is gone
+static bool console_read(int fd) {
+  uint32_t tail = rx_tail;
+  uint32_t room = RX_RING_SIZE - (tail - __atomic_load_n(&rx_head, __ATOMIC_ACQUIRE));
+  if (room == 0) {
+    // leave the input in the host until the guest catches up
+    usleep(1000);
+    return true;
+  }
+  uint32_t off = tail % RX_RING_SIZE;
+  ssize_t n = read(fd, rx_ring + off, (room < RX_RING_SIZE - off ? room : RX_RING_SIZE - off));
+  if (n < 0) return (errno == EAGAIN || errno == EINTR);
+  if (n == 0) return false;
+  __atomic_store_n(&rx_tail, tail + n, __ATOMIC_RELEASE);
+  if (__atomic_load_n(&ier, __ATOMIC_RELAXED) & IER_ERBFI) dev_raise_intr(IRQ_SERIAL);
+  return true;
 }
 
+static void set_console(int ep, int fd) {
+  if (console_fd >= 0) {
+    epoll_ctl(ep, EPOLL_CTL_DEL, console_fd, NULL);
+    __atomic_store_n(&out_fd, -1, __ATOMIC_RELEASE);
+    close(console_fd);
+  }
+  console_fd = fd;
+  if (fd >= 0) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    __atomic_store_n(&out_fd, fd, __ATOMIC_RELEASE);
+  }
+}
+
+static void* console_thread(void *arg) {
+  int ep = epoll_create1(0);
+  Assert(ep >= 0, "Can not create epoll instance");
+  if (listen_fd >= 0) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = listen_fd };
+    epoll_ctl(ep, EPOLL_CTL_ADD, listen_fd, &ev);
+  }
+  int fd = console_fd;
+  console_fd = -1;
+  set_console(ep, fd);
+
+  while (true) {
+    struct epoll_event ev[2];
+    int n = epoll_wait(ep, ev, 2, -1);
+    for (int i = 0; i < n; i ++) {
+      if (ev[i].data.fd == listen_fd) {
+        // a new client replaces the old one
+        set_console(ep, accept(listen_fd, NULL, NULL));
+      } else if (!console_read(ev[i].data.fd)) {
+        set_console(ep, -1);
+      }
+    }
+  }
+  return NULL;
+}
+
+#ifdef CONFIG_SERIAL_PTY
+static void init_console() {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  Assert(fd >= 0 && grantpt(fd) == 0 && unlockpt(fd) == 0, "Can not create the pseudo terminal");
+  const char *name = ptsname(fd);
+  // Keep the slave open, so that the master works before and after a
+  // terminal is attached. The output is dropped if no one reads it.
+  int slave = open(name, O_RDWR | O_NOCTTY);
+  Assert(slave >= 0, "Can not open %s", name);
+  struct termios t;
+  tcgetattr(slave, &t);
+  cfmakeraw(&t);
+  tcsetattr(slave, TCSANOW, &t);
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  console_fd = fd;
+  Log("Serial console at %s", name);
+}
+#else
+static void init_console() {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  strncpy(addr.sun_path, CONFIG_SERIAL_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+  unlink(addr.sun_path);
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  Assert(listen_fd >= 0 && bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+      listen(listen_fd, 1) == 0, "Can not listen on %s", addr.sun_path);
+  // a client going away should not kill NEMU
+  signal(SIGPIPE, SIG_IGN);
+  // wait for the first client, so that no output is lost
+  Log("Serial console at %s, waiting for connection", addr.sun_path);
+  console_fd = accept(listen_fd, NULL, NULL);
+  Assert(console_fd >= 0, "Can not accept on %s", addr.sun_path);
+}
+#endif
+#else
+// The input is read from the FIFO without blocking, and buffered to
+// reduce the number of syscalls when the guest polls the line status.
+#define RX_FIFO "/tmp/nemu.serial"
+#define RBUF_SIZE 256
+
+static int rx_fd = -1;
+static uint8_t rbuf[RBUF_SIZE];
+static int rbuf_head = 0, rbuf_tail = 0;
+
+static bool serial_rx_ready() {
+  if (rbuf_head == rbuf_tail && rx_fd >= 0) {
+    ssize_t n = read(rx_fd, rbuf, RBUF_SIZE);
+    rbuf_head = 0;
+    rbuf_tail = (n > 0 ? n : 0);
+  }
+  return rbuf_head != rbuf_tail;
+}
+
+static uint8_t serial_getc() {
+  return (serial_rx_ready() ? rbuf[rbuf_head ++] : 0);
+}
+
+#ifdef CONFIG_SERIAL_INPUT_FIFO
+static void init_rx_fifo() {
+  if (access(RX_FIFO, F_OK) != 0) {
+    Assert(mkfifo(RX_FIFO, 0644) == 0, "Can not create the input FIFO %s", RX_FIFO);
+  }
+  rx_fd = open(RX_FIFO, O_RDONLY | O_NONBLOCK);
+  Assert(rx_fd >= 0, "Can not open the input FIFO %s", RX_FIFO);
+  Log("Serial input from %s", RX_FIFO);
+}
+#endif
+#endif
+#endif
+
 static void serial_io_handler(uint32_t offset, int len, bool is_write) {
   assert(len == 1);
+  bool dlab = (serial_base[LCR_OFFSET] & LCR_DLAB) != 0;
   switch (offset) {
-    /* We bind the serial port with the host stderr in NEMU. */
+    /* We bind the serial port with the host stderr or the console in NEMU. */
     case CH_OFFSET:
-      if (is_write) serial_putc(serial_base[0]);
-      else panic("do not support read");
+      if (dlab) {
+        if (is_write) dll = serial_base[CH_OFFSET];
+        else serial_base[CH_OFFSET] = dll;
+      }
+      else if (is_write) serial_putc(serial_base[CH_OFFSET]);
+      else serial_base[CH_OFFSET] = serial_getc();
+      break;
+    case IER_OFFSET:
+      if (dlab) {
+        if (is_write) dlm = serial_base[IER_OFFSET];
+        else serial_base[IER_OFFSET] = dlm;
+      }
+      else if (is_write) {
+        __atomic_store_n(&ier, serial_base[IER_OFFSET] & IER_MASK, __ATOMIC_RELAXED);
+        // the input which arrived before the interrupt is enabled is pending at once
+        if ((ier & IER_ERBFI) && serial_rx_ready()) dev_raise_intr(IRQ_SERIAL);
+      }
+      else serial_base[IER_OFFSET] = ier;
+      break;
+    case IIR_OFFSET:
+      if (!is_write) serial_base[IIR_OFFSET] =
+        ((ier & IER_ERBFI) && serial_rx_ready() ? IIR_RDA : IIR_NO_INT);
+      break;
+    case LSR_OFFSET:
+      if (!is_write) serial_base[LSR_OFFSET] = LSR_THRE | LSR_TEMT | (serial_rx_ready() ? LSR_DR : 0);
+      break;
+    case MSR_OFFSET:
+      // a modem is always present, and the writes are ignored
+      if (!is_write) serial_base[MSR_OFFSET] = MSR_DCD | MSR_DSR | MSR_CTS;
+      break;
+    case LCR_OFFSET:
+    case MCR_OFFSET:
+    case SCR_OFFSET:
       break;
     default: panic("do not support offset = %d", offset);
   }
 }
 
+static bool serial_intr_level() {
+  return (ier & IER_ERBFI) && serial_rx_ready();
+}
+
 void init_serial() {
   serial_base = new_space(8);
 #ifdef CONFIG_HAS_PORT_IO
@@ -47,5 +383,21 @@ void init_serial() {
 #else
   add_mmio_map("serial", CONFIG_SERIAL_MMIO, serial_base, 8, serial_io_handler);
 #endif
+  dev_set_intr_level(IRQ_SERIAL, serial_intr_level);
 
+#ifndef CONFIG_TARGET_AM
+  IFDEF(CONFIG_SERIAL_INPUT_FIFO, init_rx_fifo());
+#ifdef CONFIG_SERIAL_CONSOLE
+  init_console();
+  pthread_t console;
+  int err = pthread_create(&console, NULL, console_thread, NULL);
+  Assert(err == 0, "failed to create the serial console thread");
+  pthread_detach(console);
+#endif
+#ifdef CONFIG_SERIAL_OUTPUT_THREAD
+  int ret = pthread_create(&writer, NULL, writer_thread, NULL);
+  Assert(ret == 0, "failed to create the serial writer thread");
+#endif
+  atexit(serial_exit);
+#endif
 }
@@ -34,18 +34,63 @@ static uint32_t screen_size() {
 static void *vmem = NULL;
 static uint32_t *vgactl_port_base = NULL;
 
+// Lines of vmem written since the last sync, only these lines are
+// uploaded to the screen. [dirty_lo, dirty_hi) covers all dirty lines.
+static bool *dirty = NULL;
+static int dirty_lo = 0, dirty_hi = 0;
+
+// extend [*lo, *hi) to cover [l, h)
+static void merge_range(int *lo, int *hi, int l, int h) {
+  if (*lo == *hi) { *lo = l; *hi = h; return; }
+  if (l < *lo) *lo = l;
+  if (h > *hi) *hi = h;
+}
+
+static void mark_dirty(int lo, int hi) {
+  for (int y = lo; y < hi; y ++) dirty[y] = true;
+  merge_range(&dirty_lo, &dirty_hi, lo, hi);
+}
+
+static void clear_dirty() {
+  memset(dirty + dirty_lo, 0, dirty_hi - dirty_lo);
+  dirty_lo = dirty_hi = 0;
+}
+
+static void vmem_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write) return;
+  uint32_t line = screen_width() * sizeof(uint32_t);
+  int y = offset / line;
+  int y_end = (offset + len - 1) / line + 1;
+  if (y_end > screen_height()) y_end = screen_height();
+  if (dirty[y] && dirty[y_end - 1]) return;
+  mark_dirty(y, y_end);
+}
+
 #ifdef CONFIG_VGA_SHOW_SCREEN
 #ifndef CONFIG_TARGET_AM
 #include <SDL2/SDL.h>
+#include <device/alarm.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
+// The dirty lines of vmem are copied to the front buffer on sync. The
+// render thread uploads them to the texture and presents it, so the
+// CPU never waits for SDL. If the render thread is still busy with the
+// front buffer, the lines stay dirty and are copied on the next sync.
+static uint32_t *front = NULL;
+static bool *front_dirty = NULL;
+static int front_lo = 0, front_hi = 0;
+static pthread_mutex_t front_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t front_ready = PTHREAD_COND_INITIALIZER;
 
 static SDL_Renderer *renderer = NULL;
 static SDL_Texture *texture = NULL;
 
-static void init_screen() {
+static void create_screen() {
   SDL_Window *window = NULL;
   char title[128];
   sprintf(title, "%s-NEMU", str(__GUEST_ISA__));
-  SDL_Init(SDL_INIT_VIDEO);
   SDL_CreateWindowAndRenderer(
       SCREEN_W * (MUXDEF(CONFIG_VGA_SIZE_400x300, 2, 1)),
       SCREEN_H * (MUXDEF(CONFIG_VGA_SIZE_400x300, 2, 1)),
@@ -56,24 +101,263 @@ static void init_screen() {
   SDL_RenderPresent(renderer);
 }
 
-static inline void update_screen() {
-  SDL_UpdateTexture(texture, NULL, vmem, SCREEN_W * sizeof(uint32_t));
-  SDL_RenderClear(renderer);
-  SDL_RenderCopy(renderer, texture, NULL, NULL);
-  SDL_RenderPresent(renderer);
+// upload each run of dirty lines with one call
+static void upload_dirty_lines() {
+  int y = front_lo;
+  while (y < front_hi) {
+    if (!front_dirty[y]) { y ++; continue; }
+    int y0 = y;
+    while (y < front_hi && front_dirty[y]) front_dirty[y ++] = false;
+    SDL_Rect rect = { .x = 0, .y = y0, .w = SCREEN_W, .h = y - y0 };
+    SDL_UpdateTexture(texture, &rect, front + y0 * SCREEN_W, SCREEN_W * sizeof(uint32_t));
+  }
+  front_lo = front_hi = 0;
+}
+
+static void* render_thread(void *arg) {
+  void device_poll_events();
+  // the renderer and the events belong to the thread creating the window
+  create_screen();
+  pthread_mutex_lock(&front_lock);
+  while (true) {
+    // wake up at TIMER_HZ to handle input events without new frames
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += 1000000000 / TIMER_HZ;
+    if (ts.tv_nsec >= 1000000000) { ts.tv_sec ++; ts.tv_nsec -= 1000000000; }
+    int ret = 0;
+    while (front_lo == front_hi && ret != ETIMEDOUT) {
+      ret = pthread_cond_timedwait(&front_ready, &front_lock, &ts);
+    }
+    bool has_frame = (front_lo != front_hi);
+    if (has_frame) upload_dirty_lines();
+    pthread_mutex_unlock(&front_lock);
+
+    device_poll_events();
+    if (has_frame) {
+      SDL_RenderClear(renderer);
+      SDL_RenderCopy(renderer, texture, NULL, NULL);
+      SDL_RenderPresent(renderer);
+    }
+    pthread_mutex_lock(&front_lock);
+  }
+  return NULL;
+}
+
+static void init_screen() {
+  front = calloc(SCREEN_W * SCREEN_H, sizeof(uint32_t));
+  front_dirty = calloc(SCREEN_H, sizeof(bool));
+  assert(front && front_dirty);
+  SDL_Init(SDL_INIT_VIDEO);
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, render_thread, NULL);
+  Assert(ret == 0, "failed to create the render thread");
+  pthread_detach(thread);
+}
+
+static inline bool update_screen() {
+  if (pthread_mutex_trylock(&front_lock) != 0) return false;
+  for (int y = dirty_lo; y < dirty_hi; y ++) {
+    if (!dirty[y]) continue;
+    memcpy(front + y * SCREEN_W, (uint32_t *)vmem + y * SCREEN_W, SCREEN_W * sizeof(uint32_t));
+    front_dirty[y] = true;
+  }
+  merge_range(&front_lo, &front_hi, dirty_lo, dirty_hi);
+  clear_dirty();
+  pthread_cond_signal(&front_ready);
+  pthread_mutex_unlock(&front_lock);
+  return true;
 }
 #else
 static void init_screen() {}
 
-static inline void update_screen() {
-  io_write(AM_GPU_FBDRAW, 0, 0, vmem, screen_width(), screen_height(), true);
+static inline bool update_screen() {
+  uint32_t w = screen_width();
+  int y = dirty_lo;
+  while (y < dirty_hi) {
+    if (!dirty[y]) { y ++; continue; }
+    int y0 = y;
+    while (y < dirty_hi && dirty[y]) y ++;
+    io_write(AM_GPU_FBDRAW, 0, y0, (uint32_t *)vmem + y0 * w, w, y - y0, false);
+  }
+  io_write(AM_GPU_FBDRAW, 0, 0, NULL, 0, 0, true);
+  clear_dirty();
+  return true;
 }
 #endif
+#elif defined(CONFIG_VGA_HEADLESS)
+#include <device/alarm.h>
+#include <pthread.h>
+
+// Frames are queued and encoded by a writer thread. PPM files get the
+// changed frames only: a frame is changed if the hash of vmem differs from
+// the last queued frame, since dirty lines may be rewritten with the same
+// pixels. A Y4M video plays at TIMER_HZ, so the last synced frame is queued
+// on every device update instead, repeated while the screen is static.
+#define NR_FRAME 8
+
+static uint32_t *frames[NR_FRAME] = {};
+static int frame_head = 0, frame_count = 0;
+static bool frame_done = false;
+static pthread_mutex_t frame_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frame_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t frame_free = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+
+static const char *capture_path = CONFIG_VGA_HEADLESS_PATH;
+static bool is_y4m = false;
+static FILE *y4m_fp = NULL;
+static uint8_t *enc_buf = NULL;
+static uint64_t last_hash = 0;
+static bool has_last = false;
+static uint32_t *shown = NULL; // the last synced frame of a Y4M video
+
+static uint64_t hash_vmem() {
+  uint64_t *p = vmem, h = 0xcbf29ce484222325ull;
+  for (int i = 0; i < SCREEN_W * SCREEN_H / 2; i ++) {
+    h = (h ^ p[i]) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+static void write_ppm(uint32_t *fb, int idx) {
+  char path[256];
+  snprintf(path, sizeof(path), capture_path, idx);
+  FILE *fp = fopen(path, "wb");
+  Assert(fp, "Can not open '%s'", path);
+  fprintf(fp, "P6\n%d %d\n255\n", SCREEN_W, SCREEN_H);
+  uint8_t *p = enc_buf;
+  for (int i = 0; i < SCREEN_W * SCREEN_H; i ++) {
+    *p ++ = fb[i] >> 16;
+    *p ++ = fb[i] >> 8;
+    *p ++ = fb[i];
+  }
+  fwrite(enc_buf, 1, SCREEN_W * SCREEN_H * 3, fp);
+  fclose(fp);
+}
+
+// full-range BT.601 without chroma subsampling
+static void write_y4m(uint32_t *fb) {
+  int n = SCREEN_W * SCREEN_H;
+  uint8_t *y = enc_buf, *u = y + n, *v = u + n;
+  for (int i = 0; i < n; i ++) {
+    int r = (fb[i] >> 16) & 0xff, g = (fb[i] >> 8) & 0xff, b = fb[i] & 0xff;
+    y[i] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+    u[i] = ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
+    v[i] = ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
+  }
+  fputs("FRAME\n", y4m_fp);
+  fwrite(enc_buf, 1, n * 3, y4m_fp);
+}
+
+static void* writer_thread(void *arg) {
+  int idx = 0;
+  pthread_mutex_lock(&frame_lock);
+  while (true) {
+    while (frame_count == 0 && !frame_done) pthread_cond_wait(&frame_ready, &frame_lock);
+    if (frame_count == 0) break;
+    uint32_t *fb = frames[frame_head];
+    pthread_mutex_unlock(&frame_lock);
+
+    if (is_y4m) write_y4m(fb);
+    else write_ppm(fb, idx);
+    idx ++;
+
+    pthread_mutex_lock(&frame_lock);
+    frame_head = (frame_head + 1) % NR_FRAME;
+    frame_count --;
+    pthread_cond_signal(&frame_free);
+  }
+  pthread_mutex_unlock(&frame_lock);
+  if (y4m_fp) fclose(y4m_fp);
+  return NULL;
+}
+
+// write the queued frames before exiting
+static void finish_capture() {
+  pthread_mutex_lock(&frame_lock);
+  frame_done = true;
+  pthread_cond_signal(&frame_ready);
+  pthread_mutex_unlock(&frame_lock);
+  pthread_join(writer, NULL);
+}
+
+static void init_screen() {
+  is_y4m = (strchr(capture_path, '%') == NULL);
+  if (is_y4m) {
+    y4m_fp = fopen(capture_path, "wb");
+    Assert(y4m_fp, "Can not open '%s'", capture_path);
+    fprintf(y4m_fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", SCREEN_W, SCREEN_H, TIMER_HZ);
+  }
+  enc_buf = malloc(SCREEN_W * SCREEN_H * 3);
+  assert(enc_buf);
+  for (int i = 0; i < NR_FRAME; i ++) {
+    frames[i] = malloc(SCREEN_W * SCREEN_H * sizeof(uint32_t));
+    assert(frames[i]);
+  }
+  if (is_y4m) {
+    shown = calloc(SCREEN_W * SCREEN_H, sizeof(uint32_t));
+    assert(shown);
+  }
+  int ret = pthread_create(&writer, NULL, writer_thread, NULL);
+  Assert(ret == 0, "failed to create the frame writer thread");
+  atexit(finish_capture);
+  Log("Capture the screen to %s", capture_path);
+}
+
+static void queue_frame(const uint32_t *fb) {
+  pthread_mutex_lock(&frame_lock);
+  // frames are never dropped, wait if the writer falls behind
+  while (frame_count == NR_FRAME) pthread_cond_wait(&frame_free, &frame_lock);
+  int tail = (frame_head + frame_count) % NR_FRAME;
+  pthread_mutex_unlock(&frame_lock);
+
+  // the slot at tail is not touched by the writer until it is queued
+  memcpy(frames[tail], fb, SCREEN_W * SCREEN_H * sizeof(uint32_t));
+
+  pthread_mutex_lock(&frame_lock);
+  frame_count ++;
+  pthread_cond_signal(&frame_ready);
+  pthread_mutex_unlock(&frame_lock);
+}
+
+static inline bool update_screen() {
+  clear_dirty();
+  if (is_y4m) {
+    memcpy(shown, vmem, SCREEN_W * SCREEN_H * sizeof(uint32_t));
+    return true;
+  }
+  uint64_t h = hash_vmem();
+  if (has_last && h == last_hash) return true;
+  queue_frame(vmem);
+  last_hash = h;
+  has_last = true;
+  return true;
+}
+
+// called at TIMER_HZ by device_update()
+static void capture_tick() {
+  if (is_y4m) queue_frame(shown);
+}
+#endif
+
+static void sync_screen() {
+  uint32_t *sync = &vgactl_port_base[1];
+  if (*sync == 0) return;
+  if (dirty_lo != dirty_hi) {
+#if defined(CONFIG_VGA_SHOW_SCREEN) || defined(CONFIG_VGA_HEADLESS)
+    // keep the sync request to retry on the next update if the screen is busy
+    if (!update_screen()) return;
+#else
+    clear_dirty();
 #endif
+  }
+  *sync = 0;
+}
 
 void vga_update_screen() {
-  // TODO: call `update_screen()` when the sync register is non-zero,
-  // then zero out the sync register
+  sync_screen();
+  IFDEF(CONFIG_VGA_HEADLESS, capture_tick());
 }
 
 void init_vga() {
@@ -86,7 +370,12 @@ void init_vga() {
 #endif
 
   vmem = new_space(screen_size());
-  add_mmio_map("vmem", CONFIG_FB_ADDR, vmem, screen_size(), NULL);
-  IFDEF(CONFIG_VGA_SHOW_SCREEN, init_screen());
-  IFDEF(CONFIG_VGA_SHOW_SCREEN, memset(vmem, 0, screen_size()));
+  dirty = calloc(screen_height(), sizeof(bool));
+  assert(dirty);
+  add_mmio_map("vmem", CONFIG_FB_ADDR, vmem, screen_size(), vmem_io_handler);
+#if defined(CONFIG_VGA_SHOW_SCREEN) || defined(CONFIG_VGA_HEADLESS)
+  init_screen();
+  memset(vmem, 0, screen_size());
+#endif
+  mark_dirty(0, screen_height());
 }
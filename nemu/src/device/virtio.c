@@ -0,0 +1,475 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <utils.h>
+#include <device/map.h>
+#include <device/intr.h>
+#include <memory/paddr.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+
+// virtio-mmio (version 2) with split virtqueues, see the virtio 1.x spec.
+// The rings and the buffers are accessed in place in pmem, and requests
+// are done synchronously when the guest notifies the queue, so a guest can
+// submit a batch of requests with a single MMIO write.
+
+#define VIRTIO_MAGIC  0x74726976 // "virt"
+#define VIRTIO_VENDOR 0x554d454e // "NEMU"
+#define VIRTIO_SPACE_SIZE 0x200
+#define VIRTIO_CONFIG 0x100
+#define VIRTQ_MAX 256
+
+enum {
+  reg_magic           = 0x000,
+  reg_version         = 0x004,
+  reg_device_id       = 0x008,
+  reg_vendor_id       = 0x00c,
+  reg_dev_features    = 0x010,
+  reg_dev_features_sel= 0x014,
+  reg_drv_features    = 0x020,
+  reg_drv_features_sel= 0x024,
+  reg_queue_sel       = 0x030,
+  reg_queue_num_max   = 0x034,
+  reg_queue_num       = 0x038,
+  reg_queue_ready     = 0x044,
+  reg_queue_notify    = 0x050,
+  reg_intr_status     = 0x060,
+  reg_intr_ack        = 0x064,
+  reg_status          = 0x070,
+  reg_queue_desc_lo   = 0x080,
+  reg_queue_desc_hi   = 0x084,
+  reg_queue_avail_lo  = 0x090,
+  reg_queue_avail_hi  = 0x094,
+  reg_queue_used_lo   = 0x0a0,
+  reg_queue_used_hi   = 0x0a4,
+  reg_config_gen      = 0x0fc,
+};
+
+#define VIRTIO_F_VERSION_1 (1ull << 32)
+#define VIRTQ_DESC_F_NEXT  1
+#define VIRTQ_DESC_F_WRITE 2
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 1
+#define VIRTIO_INT_USED 1
+
+typedef struct {
+  uint64_t addr;
+  uint32_t len;
+  uint16_t flags;
+  uint16_t next;
+} VirtqDesc;
+
+typedef struct {
+  uint32_t num, ready;
+  uint64_t desc, avail, used;
+  uint16_t last_avail;
+} Virtq;
+
+typedef struct {
+  uint8_t *p;
+  uint32_t len;
+  bool is_write;
+} VirtBuf;
+
+typedef struct VirtioDev {
+  const char *name;
+  uint32_t *base;
+  uint32_t device_id;
+  uint64_t features, drv_features;
+  uint32_t features_sel, drv_features_sel;
+  uint32_t status, intr_status, queue_sel;
+  int irq, nr_queue;
+  Virtq vq[2];
+  void (*notify)(struct VirtioDev *dev, int q);
+} VirtioDev;
+
+static void *guest_buf(uint64_t addr, uint64_t len) {
+  Assert(addr - CONFIG_MBASE < CONFIG_MSIZE && len <= CONFIG_MSIZE - (addr - CONFIG_MBASE),
+      "virtio buffer at 0x%" PRIx64 " with %" PRIu64 " bytes is out of pmem", addr, len);
+  return guest_to_host(addr);
+}
+
+static uint16_t *avail_idx(Virtq *vq) { return guest_buf(vq->avail + 2, 2); }
+
+// Take the next chain from the avail ring, return the number of buffers
+// in it, or -1 if the ring is empty.
+static int vq_pop(Virtq *vq, uint16_t *head, VirtBuf *bufs, int max) {
+  if (!vq->ready || vq->last_avail == *avail_idx(vq)) return -1;
+  uint16_t *ring = guest_buf(vq->avail + 4, sizeof(uint16_t) * vq->num);
+  VirtqDesc *desc = guest_buf(vq->desc, sizeof(VirtqDesc) * vq->num);
+  uint16_t i = ring[vq->last_avail % vq->num];
+  vq->last_avail ++;
+  *head = i;
+  int n = 0;
+  while (true) {
+    Assert(i < vq->num && n < max, "bad virtqueue descriptor chain");
+    bufs[n].p = guest_buf(desc[i].addr, desc[i].len);
+    bufs[n].len = desc[i].len;
+    bufs[n].is_write = (desc[i].flags & VIRTQ_DESC_F_WRITE) != 0;
+    n ++;
+    if (!(desc[i].flags & VIRTQ_DESC_F_NEXT)) break;
+    i = desc[i].next;
+  }
+  return n;
+}
+
+static void vq_push(Virtq *vq, uint16_t head, uint32_t len) {
+  uint16_t *used_idx = guest_buf(vq->used + 2, 2);
+  uint32_t *elem = guest_buf(vq->used + 4 + 8 * (*used_idx % vq->num), 8);
+  elem[0] = head;
+  elem[1] = len;
+  (*used_idx) ++;
+}
+
+static void virtio_raise_intr(VirtioDev *dev, Virtq *vq) {
+  uint16_t flags = *(uint16_t *)guest_buf(vq->avail, 2);
+  if (flags & VIRTQ_AVAIL_F_NO_INTERRUPT) return;
+  dev->intr_status |= VIRTIO_INT_USED;
+  dev_raise_intr(dev->irq);
+}
+
+static void virtio_reset(VirtioDev *dev) {
+  dev->drv_features = 0;
+  dev->features_sel = dev->drv_features_sel = 0;
+  dev->status = dev->intr_status = dev->queue_sel = 0;
+  memset(dev->vq, 0, sizeof(dev->vq));
+}
+
+static uint32_t virtio_reg_read(VirtioDev *dev, uint32_t offset) {
+  Virtq *vq = (dev->queue_sel < dev->nr_queue ? &dev->vq[dev->queue_sel] : NULL);
+  switch (offset) {
+    case reg_magic: return VIRTIO_MAGIC;
+    case reg_version: return 2;
+    case reg_device_id: return dev->device_id;
+    case reg_vendor_id: return VIRTIO_VENDOR;
+    case reg_dev_features: return (dev->features_sel > 1 ? 0 : dev->features >> (32 * dev->features_sel));
+    case reg_queue_num_max: return (vq ? VIRTQ_MAX : 0);
+    case reg_queue_ready: return (vq ? vq->ready : 0);
+    case reg_intr_status: return dev->intr_status;
+    case reg_status: return dev->status;
+    case reg_config_gen: return 0;
+    default: return dev->base[offset / 4];
+  }
+}
+
+static void virtio_reg_write(VirtioDev *dev, uint32_t offset, uint32_t data) {
+  Virtq *vq = (dev->queue_sel < dev->nr_queue ? &dev->vq[dev->queue_sel] : NULL);
+  switch (offset) {
+    case reg_dev_features_sel: dev->features_sel = data; break;
+    case reg_drv_features_sel: dev->drv_features_sel = data; break;
+    case reg_drv_features:
+      if (dev->drv_features_sel <= 1) {
+        int shift = 32 * dev->drv_features_sel;
+        dev->drv_features = (dev->drv_features & ~(0xffffffffull << shift)) | ((uint64_t)data << shift);
+      }
+      break;
+    case reg_queue_sel: dev->queue_sel = data; break;
+    case reg_queue_num: if (vq) vq->num = (data > VIRTQ_MAX ? VIRTQ_MAX : data); break;
+    case reg_queue_ready: if (vq) vq->ready = (data & 1) && vq->num > 0; break;
+    case reg_queue_desc_lo:  if (vq) vq->desc  = (vq->desc  & ~0xffffffffull) | data; break;
+    case reg_queue_desc_hi:  if (vq) vq->desc  = (vq->desc  & 0xffffffffull) | ((uint64_t)data << 32); break;
+    case reg_queue_avail_lo: if (vq) vq->avail = (vq->avail & ~0xffffffffull) | data; break;
+    case reg_queue_avail_hi: if (vq) vq->avail = (vq->avail & 0xffffffffull) | ((uint64_t)data << 32); break;
+    case reg_queue_used_lo:  if (vq) vq->used  = (vq->used  & ~0xffffffffull) | data; break;
+    case reg_queue_used_hi:  if (vq) vq->used  = (vq->used  & 0xffffffffull) | ((uint64_t)data << 32); break;
+    case reg_queue_notify: if (data < dev->nr_queue) dev->notify(dev, data); break;
+    case reg_intr_ack: dev->intr_status &= ~data; break;
+    case reg_status: if (data == 0) virtio_reset(dev); else dev->status = data; break;
+    default: break;
+  }
+}
+
+static void virtio_io_handler(VirtioDev *dev, uint32_t offset, int len, bool is_write) {
+  // the config space is kept in the mapped space and accessed directly
+  if (offset >= VIRTIO_CONFIG) return;
+  Assert(len == 4 && offset % 4 == 0, "%s: registers must be accessed as aligned words", dev->name);
+  if (is_write) virtio_reg_write(dev, offset, dev->base[offset / 4]);
+  else dev->base[offset / 4] = virtio_reg_read(dev, offset);
+}
+
+static void virtio_init_dev(VirtioDev *dev, const char *name, paddr_t addr, int irq, io_callback_t handler) {
+  dev->name = name;
+  dev->irq = irq;
+  dev->base = (uint32_t *)new_space(VIRTIO_SPACE_SIZE);
+  memset(dev->base, 0, VIRTIO_SPACE_SIZE);
+  add_mmio_map(name, addr, dev->base, VIRTIO_SPACE_SIZE, handler);
+}
+
+// ----------------------------- block device -----------------------------
+
+#define VIRTIO_ID_BLK 2
+#define VIRTIO_BLK_F_RO (1ull << 5)
+#define VIRTIO_BLK_F_FLUSH (1ull << 9)
+#define SECTOR_SIZE 512
+
+enum { VIRTIO_BLK_T_IN = 0, VIRTIO_BLK_T_OUT = 1, VIRTIO_BLK_T_FLUSH = 4, VIRTIO_BLK_T_GET_ID = 8 };
+enum { VIRTIO_BLK_S_OK = 0, VIRTIO_BLK_S_IOERR = 1, VIRTIO_BLK_S_UNSUPP = 2 };
+
+typedef struct {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t sector;
+} VirtioBlkReq;
+
+static VirtioDev blk = {};
+static uint8_t *blk_img = NULL;
+static uint64_t blk_size = 0;
+
+// A request is a read-only header, the data buffers, and a writable
+// status byte, each in its own descriptor as every driver does.
+static uint32_t blk_request(VirtBuf *bufs, int n) {
+  Assert(n >= 2 && bufs[0].len >= sizeof(VirtioBlkReq) && bufs[n - 1].is_write,
+      "bad virtio-blk request");
+  VirtioBlkReq *req = (VirtioBlkReq *)bufs[0].p;
+  uint8_t *status = bufs[n - 1].p + bufs[n - 1].len - 1;
+  uint64_t off = req->sector * SECTOR_SIZE;
+  uint32_t written = 1;
+  *status = VIRTIO_BLK_S_OK;
+  switch (req->type) {
+    case VIRTIO_BLK_T_IN:
+    case VIRTIO_BLK_T_OUT:
+      for (int i = 1; i < n - 1; i ++) {
+        if (off > blk_size || bufs[i].len > blk_size - off ||
+            (req->type == VIRTIO_BLK_T_IN) != bufs[i].is_write) {
+          *status = VIRTIO_BLK_S_IOERR;
+          break;
+        }
+        if (req->type == VIRTIO_BLK_T_IN) { memcpy(bufs[i].p, blk_img + off, bufs[i].len); written += bufs[i].len; }
+        else memcpy(blk_img + off, bufs[i].p, bufs[i].len);
+        off += bufs[i].len;
+      }
+      break;
+    case VIRTIO_BLK_T_FLUSH:
+      if (blk.features & VIRTIO_BLK_F_FLUSH) msync(blk_img, blk_size, MS_SYNC);
+      break;
+    case VIRTIO_BLK_T_GET_ID:
+      if (n >= 3 && bufs[1].is_write) {
+        uint32_t len = (bufs[1].len < 20 ? bufs[1].len : 20);
+        strncpy((char *)bufs[1].p, "nemu-virtio-blk", len);
+        written += len;
+      }
+      break;
+    default: *status = VIRTIO_BLK_S_UNSUPP; break;
+  }
+  return written;
+}
+
+static void blk_notify(VirtioDev *dev, int q) {
+  Virtq *vq = &dev->vq[q];
+  VirtBuf bufs[VIRTQ_MAX];
+  uint16_t head;
+  int n, nr_done = 0;
+  while ((n = vq_pop(vq, &head, bufs, ARRLEN(bufs))) >= 0) {
+    vq_push(vq, head, blk_request(bufs, n));
+    nr_done ++;
+  }
+  if (nr_done > 0) virtio_raise_intr(dev, vq);
+}
+
+static void blk_io_handler(uint32_t offset, int len, bool is_write) {
+  virtio_io_handler(&blk, offset, len, is_write);
+}
+
+static void init_virtio_blk() {
+  virtio_init_dev(&blk, "virtio-blk", CONFIG_VIRTIO_BLK_MMIO, IRQ_VIRTIO_BLK, blk_io_handler);
+  blk.nr_queue = 1;
+  blk.notify = blk_notify;
+
+  const char *path = CONFIG_VIRTIO_BLK_IMG_PATH;
+  if (path[0] == '\0') return; // device id 0 tells the driver there is no device
+  int fd = open(path, O_RDWR);
+  bool writable = (fd >= 0);
+  if (!writable) fd = open(path, O_RDONLY);
+  Assert(fd >= 0, "Can not open virtio-blk image: %s", path);
+  struct stat st;
+  Assert(fstat(fd, &st) == 0, "Can not stat virtio-blk image: %s", path);
+  blk_size = st.st_size / SECTOR_SIZE * SECTOR_SIZE;
+  if (blk_size > 0) {
+    // a read-only image is mapped privately so that writes are kept in NEMU
+    blk_img = mmap(NULL, blk_size, PROT_READ | PROT_WRITE, (writable ? MAP_SHARED : MAP_PRIVATE), fd, 0);
+    Assert(blk_img != MAP_FAILED, "Can not map virtio-blk image: %s", path);
+  }
+  close(fd);
+
+  blk.device_id = VIRTIO_ID_BLK;
+  blk.features = VIRTIO_F_VERSION_1 | (writable ? VIRTIO_BLK_F_FLUSH : VIRTIO_BLK_F_RO);
+  uint64_t capacity = blk_size / SECTOR_SIZE;
+  memcpy((uint8_t *)blk.base + VIRTIO_CONFIG, &capacity, sizeof(capacity));
+  Log("virtio-blk image %s, %" PRIu64 " sectors%s", path, capacity, (writable ? "" : ", read-only"));
+}
+
+// ------------------------------ net device ------------------------------
+
+#define VIRTIO_ID_NET 1
+#define VIRTIO_NET_F_MAC (1ull << 5)
+#define VIRTIO_NET_HDR_SIZE 12 // with VIRTIO_F_VERSION_1
+#define NET_FRAME_MAX 1518
+#define NET_LOOP_SIZE 64
+
+enum { NET_RXQ, NET_TXQ };
+
+static VirtioDev net = {};
+static int tap_fd = -1;
+static const char *pcap_path = CONFIG_VIRTIO_NET_PCAP_PATH;
+static FILE *pcap_fp = NULL;
+
+// Without a TAP interface the frames sent by the guest come back to it.
+static struct { uint32_t len; uint8_t data[NET_FRAME_MAX]; } loop_frame[NET_LOOP_SIZE];
+static int loop_f = 0, loop_r = 0;
+
+static void pcap_dump(struct iovec *iov, int n, uint32_t len) {
+  uint64_t us = get_time();
+  uint32_t rec[4] = { us / 1000000, us % 1000000, len, len };
+  fwrite(rec, sizeof(rec), 1, pcap_fp);
+  for (int i = 0; i < n; i ++) {
+    uint32_t l = (iov[i].iov_len < len ? iov[i].iov_len : len);
+    fwrite(iov[i].iov_base, l, 1, pcap_fp);
+    len -= l;
+  }
+}
+
+// Skip the virtio-net header at the beginning of the chain and describe
+// the frame in place with iovecs.
+static int net_frame_iov(VirtBuf *bufs, int n, struct iovec *iov) {
+  uint32_t skip = VIRTIO_NET_HDR_SIZE;
+  int nr_iov = 0;
+  for (int i = 0; i < n; i ++) {
+    uint32_t l = (bufs[i].len < skip ? bufs[i].len : skip);
+    skip -= l;
+    if (bufs[i].len > l) iov[nr_iov ++] = (struct iovec) { bufs[i].p + l, bufs[i].len - l };
+  }
+  Assert(skip == 0, "virtio-net buffer is smaller than the header");
+  return nr_iov;
+}
+
+static void net_rx() {
+  Virtq *vq = &net.vq[NET_RXQ];
+  VirtBuf bufs[VIRTQ_MAX];
+  struct iovec iov[VIRTQ_MAX];
+  uint16_t head;
+  int n, nr_done = 0;
+  while (tap_fd >= 0 || loop_r != loop_f) {
+    if ((n = vq_pop(vq, &head, bufs, ARRLEN(bufs))) < 0) break;
+    Assert(bufs[0].is_write && bufs[0].len >= VIRTIO_NET_HDR_SIZE, "bad virtio-net receive buffer");
+    int nr_iov = net_frame_iov(bufs, n, iov);
+    ssize_t len;
+    if (tap_fd >= 0) {
+      len = readv(tap_fd, iov, nr_iov);
+      if (len <= 0) { vq->last_avail --; break; } // nothing to receive, give the chain back
+    } else {
+      len = 0;
+      uint8_t *src = loop_frame[loop_r].data;
+      for (int i = 0; i < nr_iov && len < loop_frame[loop_r].len; i ++) {
+        uint32_t l = loop_frame[loop_r].len - len;
+        if (l > iov[i].iov_len) l = iov[i].iov_len;
+        memcpy(iov[i].iov_base, src + len, l);
+        len += l;
+      }
+      loop_r = (loop_r + 1) % NET_LOOP_SIZE;
+    }
+    memset(bufs[0].p, 0, VIRTIO_NET_HDR_SIZE);
+    ((uint16_t *)bufs[0].p)[5] = 1; // num_buffers
+    if (pcap_fp) pcap_dump(iov, nr_iov, len);
+    vq_push(vq, head, VIRTIO_NET_HDR_SIZE + len);
+    nr_done ++;
+  }
+  if (nr_done > 0) virtio_raise_intr(&net, vq);
+}
+
+static void net_tx() {
+  Virtq *vq = &net.vq[NET_TXQ];
+  VirtBuf bufs[VIRTQ_MAX];
+  struct iovec iov[VIRTQ_MAX];
+  uint16_t head;
+  int n, nr_done = 0;
+  while ((n = vq_pop(vq, &head, bufs, ARRLEN(bufs))) >= 0) {
+    int nr_iov = net_frame_iov(bufs, n, iov);
+    uint32_t len = 0;
+    for (int i = 0; i < nr_iov; i ++) len += iov[i].iov_len;
+    if (pcap_fp) pcap_dump(iov, nr_iov, len);
+    if (tap_fd >= 0) {
+      if (writev(tap_fd, iov, nr_iov) < 0) Log("virtio-net: drop a frame of %u bytes", len);
+    } else if ((loop_f + 1) % NET_LOOP_SIZE != loop_r && len <= NET_FRAME_MAX) {
+      uint8_t *dst = loop_frame[loop_f].data;
+      for (int i = 0; i < nr_iov; i ++) { memcpy(dst, iov[i].iov_base, iov[i].iov_len); dst += iov[i].iov_len; }
+      loop_frame[loop_f].len = len;
+      loop_f = (loop_f + 1) % NET_LOOP_SIZE;
+    }
+    vq_push(vq, head, 0);
+    nr_done ++;
+  }
+  if (nr_done > 0) virtio_raise_intr(&net, vq);
+}
+
+static void net_notify(VirtioDev *dev, int q) {
+  if (q == NET_TXQ) net_tx();
+  // new receive buffers, or frames looped back by the transmission above
+  net_rx();
+}
+
+static void net_io_handler(uint32_t offset, int len, bool is_write) {
+  virtio_io_handler(&net, offset, len, is_write);
+}
+
+static void init_virtio_net() {
+  virtio_init_dev(&net, "virtio-net", CONFIG_VIRTIO_NET_MMIO, IRQ_VIRTIO_NET, net_io_handler);
+  net.device_id = VIRTIO_ID_NET;
+  net.features = VIRTIO_F_VERSION_1 | VIRTIO_NET_F_MAC;
+  net.nr_queue = 2;
+  net.notify = net_notify;
+  uint8_t mac[6] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+  memcpy((uint8_t *)net.base + VIRTIO_CONFIG, mac, sizeof(mac));
+
+  const char *tap = CONFIG_VIRTIO_NET_TAP;
+  if (tap[0] != '\0') {
+    tap_fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+    Assert(tap_fd >= 0, "Can not open /dev/net/tun");
+    struct ifreq ifr = { .ifr_flags = IFF_TAP | IFF_NO_PI };
+    strncpy(ifr.ifr_name, tap, IFNAMSIZ - 1);
+    Assert(ioctl(tap_fd, TUNSETIFF, &ifr) == 0, "Can not attach to TAP interface %s", tap);
+    Log("virtio-net attached to TAP interface %s", tap);
+  } else {
+    Log("virtio-net loops the frames back");
+  }
+
+  if (pcap_path[0] != '\0') {
+    pcap_fp = fopen(pcap_path, "wb");
+    Assert(pcap_fp, "Can not open '%s'", pcap_path);
+    // magic, version 2.4, timezone, sigfigs, snaplen, LINKTYPE_ETHERNET
+    uint32_t hdr[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1 };
+    fwrite(hdr, sizeof(hdr), 1, pcap_fp);
+  }
+}
+
+// Frames from the TAP interface are received here, called by device_update().
+void virtio_poll() {
+  if (tap_fd >= 0) net_rx();
+}
+
+// used buffers not acknowledged by the guest yet
+static bool blk_intr_level() { return blk.intr_status != 0; }
+static bool net_intr_level() { return net.intr_status != 0; }
+
+void init_virtio() {
+  init_virtio_blk();
+  init_virtio_net();
+  dev_set_intr_level(IRQ_VIRTIO_BLK, blk_intr_level);
+  dev_set_intr_level(IRQ_VIRTIO_NET, net_intr_level);
+}
@@ -14,6 +14,7 @@
 ***************************************************************************************/
 
 #include <utils.h>
+#include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <isa.h>
 #include <cpu/difftest.h>
@@ -27,6 +28,11 @@ void set_nemu_state(int state, vaddr_t pc, int halt_ret) {
 
 __attribute__((noinline))
 void invalid_inst(vaddr_t thispc) {
+  if (g_exec_silent) {
+    set_nemu_state(NEMU_ABORT, thispc, -1);
+    return;
+  }
+
   uint32_t temp[2];
   vaddr_t pc = thispc;
   temp[0] = inst_fetch(&pc, 4);
@@ -16,11 +16,15 @@
 #include <cpu/cpu.h>
 
 void sdb_mainloop();
+bool batch_mainloop();
 
 void engine_start() {
 #ifdef CONFIG_TARGET_AM
   cpu_exec(-1);
 #else
+  /* Run the images listed in the manifest if it is given. */
+  if (batch_mainloop()) return;
+
   /* Receive commands from user. */
   sdb_mainloop();
 #endif
@@ -26,7 +26,7 @@ static const uint32_t img [] = {
   0xdeadbeef,  // some data
 };
 
-static void restart() {
+void isa_reset() {
   /* Set the initial program counter. */
   cpu.pc = RESET_VECTOR;
 
@@ -39,5 +39,5 @@ void init_isa() {
   memcpy(guest_to_host(RESET_VECTOR), img, sizeof(img));
 
   /* Initialize this virtual computer system. */
-  restart();
+  isa_reset();
 }
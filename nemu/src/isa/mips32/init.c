@@ -25,7 +25,7 @@ static const uint32_t img [] = {
   0x7000003f,  // sdbbp (used as nemu_trap)
 };
 
-static void restart() {
+void isa_reset() {
   /* Set the initial program counter. */
   cpu.pc = RESET_VECTOR;
 
@@ -38,5 +38,5 @@ void init_isa() {
   memcpy(guest_to_host(RESET_VECTOR), img, sizeof(img));
 
   /* Initialize this virtual computer system. */
-  restart();
+  isa_reset();
 }
@@ -21,6 +21,8 @@
 typedef struct {
   word_t gpr[MUXDEF(CONFIG_RVE, 16, 32)];
   vaddr_t pc;
+  word_t mstatus, mie, mtvec, mscratch, mepc, mcause, mtval, mip, satp;
+  uint64_t mcycle_off, minstret_off; // from the number of executed instructions
 } MUXDEF(CONFIG_RV64, riscv64_CPU_state, riscv32_CPU_state);
 
 // decode
@@ -28,6 +30,8 @@ typedef struct {
   uint32_t inst;
 } MUXDEF(CONFIG_RV64, riscv64_ISADecodeInfo, riscv32_ISADecodeInfo);
 
-#define isa_mmu_check(vaddr, len, type) (MMU_DIRECT)
+// translate when satp.MODE is Sv32 (or Sv39 for RV64), even in M-mode
+#define isa_mmu_check(vaddr, len, type) \
+  ((cpu.satp >> MUXDEF(CONFIG_RV64, 60, 31)) != 0 ? MMU_TRANSLATE : MMU_DIRECT)
 
 #endif
@@ -17,10 +17,14 @@
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <cpu/decode.h>
+#include <cpu/difftest.h>
 
 #define R(i) gpr(i)
-#define Mr vaddr_read
-#define Mw vaddr_write
+// an instruction faulting in the MMU is stopped before writing back
+#define Mr(addr, len) ({ word_t __data = vaddr_read(addr, len); \
+  if (unlikely(mmu_exception != 0)) goto exception; __data; })
+#define Mw(addr, len, data) ({ vaddr_write(addr, len, data); \
+  if (unlikely(mmu_exception != 0)) goto exception; })
 
 enum {
   TYPE_I, TYPE_U, TYPE_S,
@@ -47,8 +51,47 @@ static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_
   }
 }
 
+enum { CSR_WRITE, CSR_SET, CSR_CLEAR };
+
+static word_t csr_op(Decode *s, word_t addr, word_t data, int op) {
+  if (csr_is_counter(BITS(addr, 11, 0))) {
+    // the reference counts in its own way
+    difftest_skip_ref();
+    word_t old = csr_counter(BITS(addr, 11, 0));
+    // csrrs and csrrc with rs1 (or uimm) = 0 only read
+    if (op == CSR_WRITE || BITS(s->isa.inst, 19, 15) != 0) {
+      if (BITS(addr, 11, 0) >= CSR_CYCLE) { INV(s->pc); return 0; } // read-only
+      csr_counter_write(BITS(addr, 11, 0),
+          op == CSR_WRITE ? data : (op == CSR_SET ? old | data : old & ~data));
+    }
+    return old;
+  }
+  word_t *c = csr(BITS(addr, 11, 0));
+  if (c == NULL) { INV(s->pc); return 0; }
+  word_t old = *c;
+  switch (op) {
+    case CSR_WRITE: *c = data; break;
+    case CSR_SET:   *c |= data; break;
+    case CSR_CLEAR: *c &= ~data; break;
+  }
+  // a pending interrupt may be enabled now
+  if (c == &cpu.mstatus || c == &cpu.mie || c == &cpu.mip) cpu_check_intr();
+  if (c == &cpu.satp) tlb_flush();
+  return old;
+}
+
+static vaddr_t mret() {
+  bool mpie = (cpu.mstatus & MSTATUS_MPIE) != 0;
+  cpu.mstatus = (cpu.mstatus & ~MSTATUS_MIE) | (mpie ? MSTATUS_MIE : 0) | MSTATUS_MPIE;
+  cpu_check_intr();
+  return cpu.mepc;
+}
+
 static int decode_exec(Decode *s) {
   s->dnpc = s->snpc;
+  // record every executed pc, so the edges are also taken by
+  // straight-line code, traps and mret, not only by jumps
+  IFDEF(CONFIG_FUZZ_COVERAGE, cov_edge(s->pc));
 
 #define INSTPAT_INST(s) ((s)->isa.inst)
 #define INSTPAT_MATCH(s, name, type, ... /* execute body */ ) { \
@@ -64,15 +107,33 @@ static int decode_exec(Decode *s) {
   INSTPAT("??????? ????? ????? 000 ????? 01000 11", sb     , S, Mw(src1 + imm, 1, src2));
 
   INSTPAT("0000000 00001 00000 000 00000 11100 11", ebreak , N, NEMUTRAP(s->pc, R(10))); // R(10) is $a0
+  INSTPAT("0000000 00000 00000 000 00000 11100 11", ecall  , N, s->dnpc = isa_raise_intr(11, s->pc));
+  INSTPAT("0011000 00010 00000 000 00000 11100 11", mret   , N, s->dnpc = mret());
+  INSTPAT("0001000 00101 00000 000 00000 11100 11", wfi    , N, );
+  INSTPAT("0001001 ????? ????? 000 00000 11100 11", sfence_vma, N, tlb_flush());
+  INSTPAT("??????? ????? ????? 001 ????? 11100 11", csrrw  , I, R(rd) = csr_op(s, imm, src1, CSR_WRITE));
+  INSTPAT("??????? ????? ????? 010 ????? 11100 11", csrrs  , I, R(rd) = csr_op(s, imm, src1, CSR_SET));
+  INSTPAT("??????? ????? ????? 011 ????? 11100 11", csrrc  , I, R(rd) = csr_op(s, imm, src1, CSR_CLEAR));
+  INSTPAT("??????? ????? ????? 101 ????? 11100 11", csrrwi , I, R(rd) = csr_op(s, imm, BITS(s->isa.inst, 19, 15), CSR_WRITE));
+  INSTPAT("??????? ????? ????? 110 ????? 11100 11", csrrsi , I, R(rd) = csr_op(s, imm, BITS(s->isa.inst, 19, 15), CSR_SET));
+  INSTPAT("??????? ????? ????? 111 ????? 11100 11", csrrci , I, R(rd) = csr_op(s, imm, BITS(s->isa.inst, 19, 15), CSR_CLEAR));
   INSTPAT("??????? ????? ????? ??? ????? ????? ??", inv    , N, INV(s->pc));
   INSTPAT_END();
 
   R(0) = 0; // reset $zero to 0
 
   return 0;
+
+exception:
+  s->dnpc = raise_mmu_exception(s->pc);
+  return 0;
 }
 
 int isa_exec_once(Decode *s) {
   s->isa.inst = inst_fetch(&s->snpc, 4);
+  if (unlikely(mmu_exception != 0)) {
+    s->dnpc = raise_mmu_exception(s->pc);
+    return 0;
+  }
   return decode_exec(s);
 }
@@ -16,7 +16,7 @@
 #ifndef __RISCV_REG_H__
 #define __RISCV_REG_H__
 
-#include <common.h>
+#include <isa.h>
 
 static inline int check_reg_idx(int idx) {
   IFDEF(CONFIG_RT_CHECK, assert(idx >= 0 && idx < MUXDEF(CONFIG_RVE, 16, 32)));
@@ -30,4 +30,90 @@ static inline const char* reg_name(int idx) {
   return regs[check_reg_idx(idx)];
 }
 
+enum {
+  CSR_MSTATUS = 0x300, CSR_MIE = 0x304, CSR_MTVEC = 0x305,
+  CSR_MSCRATCH = 0x340, CSR_MEPC = 0x341, CSR_MCAUSE = 0x342, CSR_MTVAL = 0x343,
+  CSR_MIP = 0x344, CSR_SATP = 0x180,
+  CSR_MCYCLE = 0xb00, CSR_MINSTRET = 0xb02, CSR_MCYCLEH = 0xb80, CSR_MINSTRETH = 0xb82,
+  CSR_CYCLE = 0xc00, CSR_INSTRET = 0xc02, CSR_CYCLEH = 0xc80, CSR_INSTRETH = 0xc82,
+};
+
+#define MSTATUS_MIE  (1 << 3)
+#define MSTATUS_MPIE (1 << 7)
+#define MSTATUS_MPP  (3 << 11)
+
+#define MIP_MSIP (1 << 3)
+#define MIP_MTIP (1 << 7)
+#define MIP_MEIP (1 << 11)
+
+#define INTR_BIT ((word_t)1 << (sizeof(word_t) * 8 - 1))
+
+// return NULL for an unsupported CSR
+static inline word_t* csr(int addr) {
+  switch (addr) {
+    case CSR_MSTATUS:  return &cpu.mstatus;
+    case CSR_MIE:      return &cpu.mie;
+    case CSR_MTVEC:    return &cpu.mtvec;
+    case CSR_MSCRATCH: return &cpu.mscratch;
+    case CSR_MEPC:     return &cpu.mepc;
+    case CSR_MCAUSE:   return &cpu.mcause;
+    case CSR_MTVAL:    return &cpu.mtval;
+    case CSR_MIP:      return &cpu.mip;
+    case CSR_SATP:     return &cpu.satp;
+    default: return NULL;
+  }
+}
+
+// The counters are views of the number of executed instructions, since
+// NEMU takes one cycle for each. A write to mcycle or minstret is kept as
+// the offset from that number. cycle and instret are read-only shadows.
+static inline bool csr_is_counter(int addr) {
+  switch (addr) {
+    case CSR_MCYCLE: case CSR_MINSTRET: case CSR_CYCLE: case CSR_INSTRET: return true;
+#ifndef CONFIG_RV64
+    case CSR_MCYCLEH: case CSR_MINSTRETH: case CSR_CYCLEH: case CSR_INSTRETH: return true;
+#endif
+    default: return false;
+  }
+}
+
+static inline uint64_t* csr_counter_off(int addr) {
+  return (addr & 0x2) ? &cpu.minstret_off : &cpu.mcycle_off;
+}
+
+static inline word_t csr_counter(int addr) {
+  extern uint64_t g_nr_guest_inst;
+  uint64_t val = g_nr_guest_inst + *csr_counter_off(addr);
+  return (addr & 0x80) ? (word_t)(val >> 32) : (word_t)val;
+}
+
+static inline void csr_counter_write(int addr, word_t data) {
+  extern uint64_t g_nr_guest_inst;
+  // the writing instruction itself is counted after it is executed,
+  // but the next instruction should read the value written
+  uint64_t now = g_nr_guest_inst + 1;
+  uint64_t *off = csr_counter_off(addr);
+  uint64_t val = now + *off;
+#ifdef CONFIG_RV64
+  val = data;
+#else
+  if (addr & 0x80) val = (val & 0xffffffffu) | ((uint64_t)data << 32);
+  else val = (val & ~(uint64_t)0xffffffffu) | data;
+#endif
+  *off = val - now;
+}
+
+// the exception raised by the MMU in the current instruction, 0 if none,
+// since instruction address misaligned is never raised by the MMU
+extern word_t mmu_exception;
+// the address which caused it, for mtval
+extern vaddr_t mmu_fault_vaddr;
+
+static inline vaddr_t raise_mmu_exception(vaddr_t epc) {
+  cpu.mtval = mmu_fault_vaddr;
+  vaddr_t dnpc = isa_raise_intr(mmu_exception, epc);
+  mmu_exception = 0;
+  return dnpc;
+}
+
 #endif
@@ -14,15 +14,29 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <device/intr.h>
+#include "../local-include/reg.h"
 
 word_t isa_raise_intr(word_t NO, vaddr_t epc) {
-  /* TODO: Trigger an interrupt/exception with ``NO''.
-   * Then return the address of the interrupt/exception vector.
-   */
-
-  return 0;
+  cpu.mepc = epc;
+  cpu.mcause = NO;
+  word_t mie = (cpu.mstatus & MSTATUS_MIE) != 0;
+  cpu.mstatus = (cpu.mstatus & ~(MSTATUS_MIE | MSTATUS_MPIE)) | (mie ? MSTATUS_MPIE : 0) | MSTATUS_MPP;
+  // the vectored mode only applies to interrupts
+  if ((cpu.mtvec & 1) && (NO & INTR_BIT)) return (cpu.mtvec & ~3) + 4 * (NO & ~INTR_BIT);
+  return cpu.mtvec & ~3;
 }
 
 word_t isa_query_intr() {
+  uint32_t lines = MUXDEF(CONFIG_DEVICE, dev_query_intr(), 0);
+  cpu.mip = (cpu.mip & ~(MIP_MSIP | MIP_MTIP | MIP_MEIP)) |
+    (lines & INTR_LINE_SOFT     ? MIP_MSIP : 0) |
+    (lines & INTR_LINE_TIMER    ? MIP_MTIP : 0) |
+    (lines & INTR_LINE_EXTERNAL ? MIP_MEIP : 0);
+  if (!(cpu.mstatus & MSTATUS_MIE)) return INTR_EMPTY;
+  word_t pending = cpu.mip & cpu.mie;
+  if (pending & MIP_MEIP) return INTR_BIT | 11;
+  if (pending & MIP_MSIP) return INTR_BIT | 3;
+  if (pending & MIP_MTIP) return INTR_BIT | 7;
   return INTR_EMPTY;
 }
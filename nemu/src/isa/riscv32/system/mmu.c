@@ -16,7 +16,76 @@
 #include <isa.h>
 #include <memory/vaddr.h>
 #include <memory/paddr.h>
+#include "../local-include/reg.h"
 
-paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type) {
+// Sv32, or Sv39 for RV64
+#define LEVELS   MUXDEF(CONFIG_RV64, 3, 2)
+#define VPN_BITS MUXDEF(CONFIG_RV64, 9, 10)
+#define PTE_SIZE ((int)sizeof(word_t))
+#define SATP_PPN(satp) ((satp) & MUXDEF(CONFIG_RV64, 0xfffffffffffull, 0x3fffff))
+#define PTE_PPN(pte) ((pte) >> 10 & MUXDEF(CONFIG_RV64, 0xfffffffffffull, 0x3fffff))
+#define VPN(vaddr, level) (((vaddr) >> (PAGE_SHIFT + (level) * VPN_BITS)) & ((1 << VPN_BITS) - 1))
+
+enum { PTE_V = 0x01, PTE_R = 0x02, PTE_W = 0x04, PTE_X = 0x08, PTE_A = 0x40, PTE_D = 0x80 };
+
+word_t mmu_exception = 0;
+vaddr_t mmu_fault_vaddr = 0;
+
+// The page-walk cache keeps the last-level page table of the regions
+// recently walked, so a TLB miss usually reads a single PTE. It is
+// dropped together with the TLB.
+#define PWC_SIZE 16
+
+static struct {
+  vaddr_t region;
+  paddr_t table;
+  uint32_t epoch;
+} pwc[PWC_SIZE] = {};
+
+static paddr_t page_fault(vaddr_t vaddr, int type) {
+  static const word_t cause[] = {
+    [MEM_TYPE_IFETCH] = 12, [MEM_TYPE_READ] = 13, [MEM_TYPE_WRITE] = 15,
+  };
+  // mtval is only written when the exception is raised by the instruction
+  mmu_fault_vaddr = vaddr;
+  mmu_exception = cause[type];
   return MEM_RET_FAIL;
 }
+
+void isa_mmu_discard_fault() {
+  mmu_exception = 0;
+  mmu_fault_vaddr = 0;
+}
+
+paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type) {
+  vaddr_t region = vaddr >> (PAGE_SHIFT + VPN_BITS);
+  // entries are stamped with the epoch plus 1, so the empty ones never hit
+  typeof(pwc[0]) *c = &pwc[region % PWC_SIZE];
+  bool pwc_hit = (c->epoch == g_tlb_epoch + 1 && c->region == region);
+  paddr_t table = (pwc_hit ? c->table : (paddr_t)SATP_PPN(cpu.satp) << PAGE_SHIFT);
+  int level = (pwc_hit ? 0 : LEVELS - 1);
+  paddr_t pte_addr;
+  word_t pte;
+  while (true) {
+    pte_addr = table + VPN(vaddr, level) * PTE_SIZE;
+    pte = paddr_read(pte_addr, PTE_SIZE);
+    if (!(pte & PTE_V) || ((pte & PTE_W) && !(pte & PTE_R))) return page_fault(vaddr, type);
+    if (pte & (PTE_R | PTE_X)) break; // leaf
+    if (level == 0) return page_fault(vaddr, type);
+    table = (paddr_t)PTE_PPN(pte) << PAGE_SHIFT;
+    level --;
+    if (level == 0) { c->region = region; c->table = table; c->epoch = g_tlb_epoch + 1; }
+  }
+
+  word_t need = (type == MEM_TYPE_IFETCH ? PTE_X : type == MEM_TYPE_READ ? PTE_R : PTE_W);
+  word_t ppn = PTE_PPN(pte);
+  word_t super_mask = ((word_t)1 << (level * VPN_BITS)) - 1;
+  // a superpage must be aligned
+  if (!(pte & need) || (ppn & super_mask)) return page_fault(vaddr, type);
+
+  word_t new_pte = pte | PTE_A | (type == MEM_TYPE_WRITE ? PTE_D : 0);
+  if (new_pte != pte) paddr_write(pte_addr, PTE_SIZE, new_pte);
+
+  ppn |= (vaddr >> PAGE_SHIFT) & super_mask;
+  return ((paddr_t)ppn << PAGE_SHIFT) | MEM_RET_OK;
+}
@@ -29,7 +29,7 @@ static const uint8_t img []  = {
   0xcc,                                // 100026:  int3 (used as nemu_trap)
 };
 
-static void restart() {
+void isa_reset() {
   /* Set the initial instruction pointer. */
   cpu.pc = RESET_VECTOR;
 }
@@ -45,7 +45,7 @@ void init_isa() {
   memcpy(guest_to_host(RESET_VECTOR), img, sizeof(img));
 
   /* Initialize this virtual computer system. */
-  restart();
+  isa_reset();
 
 #if 0
   void init_i8259a();
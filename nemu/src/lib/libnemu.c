@@ -0,0 +1,337 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <memory/paddr.h>
+#include <difftest-def.h>
+#include <libnemu.h>
+
+#ifndef CONFIG_PMEM_MALLOC
+#error "libnemu requires the physical memory to be allocated by malloc()"
+#endif
+
+#define NR_MMIO 16
+#define NR_REG (int)(DIFFTEST_REG_SIZE / sizeof(word_t))
+#define PAGE_SIZE (1ul << PMEM_DIRTY_SHIFT)
+#define NR_PAGE (CONFIG_MSIZE >> PMEM_DIRTY_SHIFT)
+// one more entry for the write crossing the end of pmem, rounded up to
+// be scanned a word at a time
+#define DIRTY_SIZE ROUNDUP(NR_PAGE + 1, sizeof(uint64_t))
+
+void tlb_flush();
+
+typedef struct {
+  paddr_t low, high;
+  nemu_mmio_read_t read;
+  nemu_mmio_write_t write;
+  void *opaque;
+} HostMMIO;
+
+struct NEMUMachine {
+  CPU_state cpu;
+  NEMUState state;
+  uint64_t nr_inst;
+  uint8_t *pmem;
+  // pages written since the snapshot `base' was taken or restored
+  uint8_t *dirty;
+  uint64_t base;
+  HostMMIO mmio[NR_MMIO];
+  int nr_mmio;
+  bool stop_requested;
+#ifdef CONFIG_FUZZ_COVERAGE
+  uint8_t *cov_map;
+  uint32_t cov_mask, cov_prev;
+#endif
+};
+
+struct NEMUSnapshot {
+  uint64_t id;
+  CPU_state cpu;
+  uint64_t nr_inst;
+  uint8_t *pmem;
+};
+
+extern uint64_t g_nr_guest_inst;
+extern word_t (*paddr_host_read)(paddr_t addr, int len);
+extern void (*paddr_host_write)(paddr_t addr, int len, word_t data);
+
+// The interpreter works on global state. The machine being operated is
+// switched in before each call, and its state is written back lazily
+// when another machine is switched in.
+static NEMUMachine *current = NULL;
+#ifdef CONFIG_FUZZ_COVERAGE
+// the map of machines without coverage, with a mask of 0
+static uint8_t cov_dummy = 0;
+#endif
+
+static void switch_to(NEMUMachine *m) {
+  if (current == m) return;
+  if (current != NULL) {
+    current->cpu = cpu;
+    current->state = nemu_state;
+    current->nr_inst = g_nr_guest_inst;
+    IFDEF(CONFIG_FUZZ_COVERAGE, current->cov_prev = g_cov_prev);
+  }
+  cpu = m->cpu;
+  nemu_state = m->state;
+  g_nr_guest_inst = m->nr_inst;
+  pmem_switch(m->pmem);
+  pmem_dirty = m->dirty;
+  tlb_flush();
+#ifdef CONFIG_FUZZ_COVERAGE
+  g_cov_map = m->cov_map;
+  g_cov_mask = m->cov_mask;
+  g_cov_prev = m->cov_prev;
+#endif
+  current = m;
+}
+
+static void switch_out(NEMUMachine *m) {
+  if (current != m) return;
+  pmem_switch(NULL);
+  pmem_dirty = NULL;
+#ifdef CONFIG_FUZZ_COVERAGE
+  g_cov_map = &cov_dummy;
+  g_cov_mask = 0;
+#endif
+  current = NULL;
+}
+
+static HostMMIO* find_mmio(paddr_t addr) {
+  for (int i = 0; i < current->nr_mmio; i ++) {
+    HostMMIO *r = &current->mmio[i];
+    if (addr >= r->low && addr <= r->high) return r;
+  }
+  return NULL;
+}
+
+// an access outside pmem and all MMIO regions aborts the machine
+static void bad_access() {
+  nemu_state.state = NEMU_ABORT;
+  nemu_state.halt_pc = cpu.pc;
+  nemu_state.halt_ret = -1;
+}
+
+static word_t host_mmio_read(paddr_t addr, int len) {
+  HostMMIO *r = find_mmio(addr);
+  if (r == NULL || r->read == NULL) { bad_access(); return 0; }
+  return r->read(r->opaque, addr - r->low, len);
+}
+
+static void host_mmio_write(paddr_t addr, int len, word_t data) {
+  HostMMIO *r = find_mmio(addr);
+  if (r == NULL || r->write == NULL) { bad_access(); return; }
+  r->write(r->opaque, addr - r->low, len, data);
+}
+
+static bool in_machine_pmem(uint64_t paddr, size_t n) {
+  return paddr >= CONFIG_MBASE && n <= CONFIG_MSIZE && paddr - CONFIG_MBASE <= CONFIG_MSIZE - n;
+}
+
+__EXPORT NEMUMachine* nemu_create() {
+  NEMUMachine *m = calloc(1, sizeof(NEMUMachine));
+  if (m == NULL) return NULL;
+  // large calloc() is backed by zero pages on demand
+  m->pmem = calloc(1, CONFIG_MSIZE);
+  m->dirty = calloc(1, DIRTY_SIZE);
+  if (m->pmem == NULL || m->dirty == NULL) {
+    free(m->pmem); free(m->dirty); free(m);
+    return NULL;
+  }
+  IFDEF(CONFIG_FUZZ_COVERAGE, m->cov_map = &cov_dummy);
+  paddr_host_read = host_mmio_read;
+  paddr_host_write = host_mmio_write;
+  nemu_reset(m);
+  return m;
+}
+
+__EXPORT void nemu_destroy(NEMUMachine *m) {
+  switch_out(m);
+  free(m->pmem);
+  free(m->dirty);
+  free(m);
+}
+
+__EXPORT void nemu_reset(NEMUMachine *m) {
+  switch_to(m);
+  memset(&cpu, 0, sizeof(cpu));
+  isa_reset();
+  tlb_flush();
+  nemu_state = (NEMUState) { .state = NEMU_STOP };
+  g_nr_guest_inst = 0;
+}
+
+__EXPORT int nemu_load_image(NEMUMachine *m, const void *buf, size_t size) {
+  return nemu_mem_write(m, RESET_VECTOR, buf, size);
+}
+
+__EXPORT int nemu_run(NEMUMachine *m, uint64_t n) {
+  switch_to(m);
+  m->stop_requested = false;
+  cpu_exec_silent(n);
+  switch (nemu_state.state) {
+    case NEMU_END: return NEMU_EVENT_TRAP;
+    case NEMU_ABORT: case NEMU_QUIT: return NEMU_EVENT_ABORT;
+    default: return (m->stop_requested ? NEMU_EVENT_STOP : NEMU_EVENT_NONE);
+  }
+}
+
+__EXPORT void nemu_stop(NEMUMachine *m) {
+  m->stop_requested = true;
+  if (current == m && nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+}
+
+__EXPORT uint64_t nemu_inst_count(NEMUMachine *m) {
+  switch_to(m);
+  return g_nr_guest_inst;
+}
+
+__EXPORT uint64_t nemu_trap_pc(NEMUMachine *m) {
+  switch_to(m);
+  return nemu_state.halt_pc;
+}
+
+__EXPORT int nemu_trap_code(NEMUMachine *m) {
+  switch_to(m);
+  return nemu_state.halt_ret;
+}
+
+__EXPORT int nemu_nr_reg() {
+  return NR_REG;
+}
+
+__EXPORT uint64_t nemu_reg_read(NEMUMachine *m, int idx) {
+  if (idx < 0 || idx >= NR_REG) return 0;
+  switch_to(m);
+  return ((word_t *)&cpu)[idx];
+}
+
+__EXPORT void nemu_reg_write(NEMUMachine *m, int idx, uint64_t val) {
+  if (idx < 0 || idx >= NR_REG) return;
+  switch_to(m);
+  ((word_t *)&cpu)[idx] = val;
+}
+
+__EXPORT int nemu_mem_read(NEMUMachine *m, uint64_t paddr, void *buf, size_t n) {
+  if (!in_machine_pmem(paddr, n)) return -1;
+  memcpy(buf, m->pmem + (paddr - CONFIG_MBASE), n);
+  return 0;
+}
+
+__EXPORT int nemu_mem_write(NEMUMachine *m, uint64_t paddr, const void *buf, size_t n) {
+  if (!in_machine_pmem(paddr, n)) return -1;
+  memcpy(m->pmem + (paddr - CONFIG_MBASE), buf, n);
+  if (m == current) tlb_flush(); // the page tables may be written
+  if (n > 0) {
+    size_t first = (paddr - CONFIG_MBASE) >> PMEM_DIRTY_SHIFT;
+    size_t last = (paddr - CONFIG_MBASE + n - 1) >> PMEM_DIRTY_SHIFT;
+    memset(m->dirty + first, 1, last - first + 1);
+  }
+  return 0;
+}
+
+__EXPORT int nemu_add_mmio(NEMUMachine *m, uint64_t base, uint64_t size,
+    nemu_mmio_read_t read, nemu_mmio_write_t write, void *opaque) {
+  if (m->nr_mmio == NR_MMIO || size == 0) return -1;
+  uint64_t last = base + size - 1;
+  if (last < base || (paddr_t)last != last) return -1;
+  if (base <= PMEM_RIGHT && last >= PMEM_LEFT) return -1;
+  for (int i = 0; i < m->nr_mmio; i ++) {
+    if (base <= m->mmio[i].high && last >= m->mmio[i].low) return -1;
+  }
+  m->mmio[m->nr_mmio ++] = (HostMMIO) { .low = base, .high = last,
+    .read = read, .write = write, .opaque = opaque };
+  return 0;
+}
+
+static bool page_is_zero(const uint8_t *p) {
+  const uint64_t *w = (const uint64_t *)p;
+  for (int i = 0; i < PAGE_SIZE / sizeof(uint64_t); i ++) {
+    if (w[i] != 0) return false;
+  }
+  return true;
+}
+
+__EXPORT NEMUSnapshot* nemu_snapshot(NEMUMachine *m) {
+  static uint64_t nr_snapshot = 0;
+  NEMUSnapshot *snap = malloc(sizeof(NEMUSnapshot));
+  if (snap == NULL) return NULL;
+  // pages never touched by the guest stay as zero pages in the copy
+  snap->pmem = calloc(1, CONFIG_MSIZE);
+  if (snap->pmem == NULL) { free(snap); return NULL; }
+  for (size_t i = 0; i < NR_PAGE; i ++) {
+    uint8_t *p = m->pmem + i * PAGE_SIZE;
+    if (!page_is_zero(p)) memcpy(snap->pmem + i * PAGE_SIZE, p, PAGE_SIZE);
+  }
+  switch_to(m);
+  snap->id = ++ nr_snapshot;
+  snap->cpu = cpu;
+  snap->nr_inst = g_nr_guest_inst;
+  memset(m->dirty, 0, DIRTY_SIZE);
+  m->base = snap->id;
+  return snap;
+}
+
+__EXPORT int nemu_restore(NEMUMachine *m, NEMUSnapshot *snap) {
+  switch_to(m);
+  cpu = snap->cpu;
+  nemu_state = (NEMUState) { .state = NEMU_STOP };
+  g_nr_guest_inst = snap->nr_inst;
+  IFDEF(CONFIG_FUZZ_COVERAGE, g_cov_prev = 0);
+  tlb_flush();
+
+  if (m->base != snap->id) {
+    memcpy(m->pmem, snap->pmem, CONFIG_MSIZE);
+    memset(m->dirty, 0, DIRTY_SIZE);
+    m->base = snap->id;
+    return 0;
+  }
+
+  // scan the dirty map a word at a time, most of it is clean
+  uint64_t *w = (uint64_t *)m->dirty;
+  for (size_t i = 0; i < DIRTY_SIZE / sizeof(uint64_t); i ++) {
+    if (w[i] == 0) continue;
+    for (size_t j = i * sizeof(uint64_t); j < (i + 1) * sizeof(uint64_t) && j < NR_PAGE; j ++) {
+      if (m->dirty[j]) memcpy(m->pmem + j * PAGE_SIZE, snap->pmem + j * PAGE_SIZE, PAGE_SIZE);
+    }
+    w[i] = 0;
+  }
+  return 0;
+}
+
+__EXPORT void nemu_snapshot_free(NEMUSnapshot *snap) {
+  if (snap == NULL) return;
+  free(snap->pmem);
+  free(snap);
+}
+
+__EXPORT int nemu_set_coverage(NEMUMachine *m, uint8_t *map, size_t size) {
+#ifdef CONFIG_FUZZ_COVERAGE
+  if (map == NULL || size == 0 || (size & (size - 1)) != 0 || size > (1ul << 24)) return -1;
+  m->cov_map = map;
+  m->cov_mask = size - 1;
+  m->cov_prev = 0;
+  if (current == m) {
+    g_cov_map = map;
+    g_cov_mask = size - 1;
+    g_cov_prev = 0;
+  }
+  return 0;
+#else
+  return -1;
+#endif
+}
@@ -19,22 +19,31 @@
 #include <isa.h>
 
 #if   defined(CONFIG_PMEM_MALLOC)
-static uint8_t *pmem = NULL;
+uint8_t *pmem = NULL;
 #else // CONFIG_PMEM_GARRAY
-static uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
+uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
 #endif
 
-uint8_t* guest_to_host(paddr_t paddr) { return pmem + paddr - CONFIG_MBASE; }
 paddr_t host_to_guest(uint8_t *haddr) { return haddr - pmem + CONFIG_MBASE; }
 
-static word_t pmem_read(paddr_t addr, int len) {
-  word_t ret = host_read(guest_to_host(addr), len);
-  return ret;
+#ifdef CONFIG_PMEM_MALLOC
+uint8_t* pmem_switch(uint8_t *new_pmem) {
+  uint8_t *old = pmem;
+  pmem = new_pmem;
+  return old;
 }
+#endif
 
-static void pmem_write(paddr_t addr, int len, word_t data) {
-  host_write(guest_to_host(addr), len, data);
-}
+#ifdef CONFIG_TARGET_SHARE
+// Set by the host when NEMU is embedded as a library. It handles the
+// accesses outside pmem instead of panicking the whole host process.
+word_t (*paddr_host_read)(paddr_t addr, int len) = NULL;
+void (*paddr_host_write)(paddr_t addr, int len, word_t data) = NULL;
+
+// Written pages are tracked so that a snapshot of the embedded machine
+// can be restored by copying back only the pages changed since then.
+uint8_t *pmem_dirty = NULL;
+#endif
 
 static void out_of_bound(paddr_t addr) {
   panic("address = " FMT_PADDR " is out of bound of pmem [" FMT_PADDR ", " FMT_PADDR "] at pc = " FMT_WORD,
@@ -50,15 +59,44 @@ void init_mem() {
   Log("physical memory area [" FMT_PADDR ", " FMT_PADDR "]", PMEM_LEFT, PMEM_RIGHT);
 }
 
-word_t paddr_read(paddr_t addr, int len) {
-  if (likely(in_pmem(addr))) return pmem_read(addr, len);
+// Accesses to pmem are inlined into the callers by paddr.h, everything
+// else comes here. An access of an odd width to pmem also comes here.
+word_t paddr_read_io(paddr_t addr, int len) {
+  if (in_pmem(addr)) return host_read(guest_to_host(addr), len);
   IFDEF(CONFIG_DEVICE, return mmio_read(addr, len));
+  IFDEF(CONFIG_TARGET_SHARE, if (paddr_host_read) return paddr_host_read(addr, len));
   out_of_bound(addr);
   return 0;
 }
 
-void paddr_write(paddr_t addr, int len, word_t data) {
-  if (likely(in_pmem(addr))) { pmem_write(addr, len, data); return; }
+void paddr_write_io(paddr_t addr, int len, word_t data) {
+  if (in_pmem(addr)) {
+    host_write(guest_to_host(addr), len, data);
+    IFDEF(CONFIG_TARGET_SHARE, if (pmem_dirty) pmem_mark_dirty(addr, len));
+    return;
+  }
   IFDEF(CONFIG_DEVICE, mmio_write(addr, len, data); return);
+  IFDEF(CONFIG_TARGET_SHARE, if (paddr_host_write) { paddr_host_write(addr, len, data); return; });
   out_of_bound(addr);
 }
+
+// the same for each width, called by paddr.h only when addr is out of pmem
+#define def_paddr_io(bits) \
+  word_t concat(paddr_read_io, bits)(paddr_t addr) { \
+    IFDEF(CONFIG_DEVICE, return concat(mmio_read, bits)(addr)); \
+    IFDEF(CONFIG_TARGET_SHARE, if (paddr_host_read) return paddr_host_read(addr, bits / 8)); \
+    out_of_bound(addr); \
+    return 0; \
+  } \
+  void concat(paddr_write_io, bits)(paddr_t addr, word_t data) { \
+    IFDEF(CONFIG_DEVICE, concat(mmio_write, bits)(addr, data); return); \
+    IFDEF(CONFIG_TARGET_SHARE, if (paddr_host_write) { paddr_host_write(addr, bits / 8, data); return; }); \
+    out_of_bound(addr); \
+  }
+
+def_paddr_io(8)
+def_paddr_io(16)
+def_paddr_io(32)
+#ifdef CONFIG_ISA64
+def_paddr_io(64)
+#endif
@@ -15,15 +15,90 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/vaddr.h>
 
-word_t vaddr_ifetch(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+// A direct-mapped soft TLB shared by fetches, reads and writes. An entry
+// remembers the types of access which have been translated successfully,
+// so a hit never walks the page table again, and the ISA only sees the
+// first access of each type to a page, e.g. to set the dirty bit.
+#define TLB_SIZE 256
+
+typedef struct {
+  vaddr_t vpn;
+  paddr_t ppage;
+  uint8_t perm; // (1 << MEM_TYPE_xxx)
+} TLBEntry;
+
+static TLBEntry tlb[TLB_SIZE] = {};
+uint32_t g_tlb_epoch = 0;
+
+void tlb_flush() {
+  memset(tlb, 0, sizeof(tlb));
+  g_tlb_epoch ++;
 }
 
-word_t vaddr_read(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+// return false on a fault, which is raised by the ISA
+static inline bool translate(vaddr_t addr, int len, int type, paddr_t *paddr) {
+  vaddr_t vpn = addr >> PAGE_SHIFT;
+  TLBEntry *e = &tlb[vpn % TLB_SIZE];
+  if (likely(e->vpn == vpn && (e->perm & (1 << type)))) {
+    *paddr = e->ppage | (addr & PAGE_MASK);
+    return true;
+  }
+  paddr_t ret = isa_mmu_translate(addr, len, type);
+  if ((ret & PAGE_MASK) != MEM_RET_OK) return false;
+  if (e->vpn != vpn) { e->vpn = vpn; e->perm = 0; }
+  e->ppage = ret & ~PAGE_MASK;
+  e->perm |= 1 << type;
+  *paddr = e->ppage | (addr & PAGE_MASK);
+  return true;
 }
 
-void vaddr_write(vaddr_t addr, int len, word_t data) {
-  paddr_write(addr, len, data);
+// an access crossing pages is done byte by byte after both pages are translated
+static bool translate_cross(vaddr_t addr, int len, int type, paddr_t pa[]) {
+  vaddr_t next = (addr | PAGE_MASK) + 1;
+  return translate(addr, next - addr, type, &pa[0]) &&
+    translate(next, len - (next - addr), type, &pa[1]);
 }
+
+static inline paddr_t cross_byte(vaddr_t addr, paddr_t pa[], int i) {
+  int len0 = PAGE_SIZE - (addr & PAGE_MASK);
+  return (i < len0 ? pa[0] + i : pa[1] + (i - len0));
+}
+
+static inline word_t mmu_read(vaddr_t addr, int len, int type) {
+  if (isa_mmu_check(addr, len, type) == MMU_DIRECT) return paddr_read(addr, len);
+  paddr_t pa[2];
+  if (likely((addr & PAGE_MASK) + len <= PAGE_SIZE)) {
+    return (translate(addr, len, type, &pa[0]) ? paddr_read(pa[0], len) : 0);
+  }
+  if (!translate_cross(addr, len, type, pa)) return 0;
+  word_t data = 0;
+  for (int i = 0; i < len; i ++) data |= (word_t)paddr_read(cross_byte(addr, pa, i), 1) << (i * 8);
+  return data;
+}
+
+static inline void mmu_write(vaddr_t addr, int len, word_t data) {
+  if (isa_mmu_check(addr, len, MEM_TYPE_WRITE) == MMU_DIRECT) { paddr_write(addr, len, data); return; }
+  paddr_t pa[2];
+  if (likely((addr & PAGE_MASK) + len <= PAGE_SIZE)) {
+    if (translate(addr, len, MEM_TYPE_WRITE, &pa[0])) paddr_write(pa[0], len, data);
+    return;
+  }
+  if (!translate_cross(addr, len, MEM_TYPE_WRITE, pa)) return;
+  for (int i = 0; i < len; i ++) paddr_write(cross_byte(addr, pa, i), 1, data >> (i * 8));
+}
+
+// With a constant len, mmu_read() and mmu_write() are inlined and the
+// access to pmem on the fast path becomes a single host load or store.
+#define def_vaddr_rw(bits) \
+  word_t concat(vaddr_ifetch, bits)(vaddr_t addr) { return mmu_read(addr, bits / 8, MEM_TYPE_IFETCH); } \
+  word_t concat(vaddr_read, bits)(vaddr_t addr) { return mmu_read(addr, bits / 8, MEM_TYPE_READ); } \
+  void concat(vaddr_write, bits)(vaddr_t addr, word_t data) { mmu_write(addr, bits / 8, data); }
+
+def_vaddr_rw(8)
+def_vaddr_rw(16)
+def_vaddr_rw(32)
+#ifdef CONFIG_ISA64
+def_vaddr_rw(64)
+#endif
@@ -0,0 +1,238 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/cpu.h>
+
+#ifndef CONFIG_TARGET_AM
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+// The batch runner executes every image listed in a manifest in its own
+// worker process. Workers are forked after the monitor is initialized, so
+// the built NEMU, the physical memory and the disassembler are shared
+// copy-on-write instead of being set up again for each image. Devices own
+// threads and timers which do not survive fork(), so every worker
+// initializes them by itself.
+//
+// Each line of the manifest is a NEMU command line without the program name:
+//   # comments and empty lines are ignored
+//   build/dummy-riscv32-nemu.bin
+//   --log=build/add-log.txt build/add-riscv32-nemu.bin
+
+#define MAX_JOB_ARGS 16
+
+typedef struct {
+  int state;
+  uint32_t halt_ret;
+  vaddr_t halt_pc;
+  uint64_t nr_inst;
+  uint64_t exec_time; // unit: us
+} BatchResult;
+
+typedef struct {
+  char *args;
+  char *argv[MAX_JOB_ARGS + 1];
+  int argc;
+  pid_t pid;
+  int fd;
+  uint64_t start;
+  uint64_t wall_time; // unit: us
+  bool finished;      // the worker reported a result
+  int signum;         // the signal which killed the worker
+  BatchResult res;
+} BatchJob;
+
+static BatchJob *jobs = NULL;
+static int nr_job = 0;
+
+extern uint64_t g_nr_guest_inst;
+void init_batch_worker(int argc, char *argv[]);
+void sdb_set_batch_mode();
+
+static void parse_manifest(const char *manifest) {
+  FILE *fp = fopen(manifest, "r");
+  Assert(fp, "Can not open '%s'", manifest);
+
+  int cap = 16;
+  jobs = malloc(sizeof(BatchJob) * cap);
+  assert(jobs);
+
+  char line[1024];
+  for (int lineno = 1; fgets(line, sizeof(line), fp) != NULL; lineno ++) {
+    line[strcspn(line, "#\n")] = '\0';
+    if (line[strspn(line, " \t\r")] == '\0') continue;
+
+    if (nr_job == cap) {
+      cap *= 2;
+      jobs = realloc(jobs, sizeof(BatchJob) * cap);
+      assert(jobs);
+    }
+    BatchJob *job = &jobs[nr_job ++];
+    memset(job, 0, sizeof(*job));
+    job->fd = -1;
+    job->args = strdup(line);
+    assert(job->args);
+
+    job->argv[job->argc ++] = "nemu";
+    for (char *p = strtok(job->args, " \t\r"); p != NULL; p = strtok(NULL, " \t\r")) {
+      Assert(job->argc < MAX_JOB_ARGS, "Too many arguments at line %d of '%s'", lineno, manifest);
+      job->argv[job->argc ++] = p;
+    }
+  }
+  fclose(fp);
+
+  Assert(nr_job > 0, "No image is listed in '%s'", manifest);
+}
+
+void init_batch(const char *manifest) {
+  parse_manifest(manifest);
+  sdb_set_batch_mode();
+}
+
+static void worker_main(BatchJob *job, int fd) {
+  // Keep the report readable. Monitor messages of the worker
+  // still go to its log file if one is given by `--log'.
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (null_fd >= 0) { dup2(null_fd, STDOUT_FILENO); close(null_fd); }
+
+  init_batch_worker(job->argc, job->argv);
+
+  uint64_t start = get_time();
+  cpu_exec(-1);
+
+  BatchResult res = {
+    .state = nemu_state.state, .halt_ret = nemu_state.halt_ret, .halt_pc = nemu_state.halt_pc,
+    .nr_inst = g_nr_guest_inst, .exec_time = get_time() - start,
+  };
+  int ret = write(fd, &res, sizeof(res));
+  // exit() runs the teardown of the devices registered by atexit(),
+  // which flushes the serial output, the captured frames and the wav file
+  exit(ret == sizeof(res) ? 0 : 1);
+}
+
+static void spawn(BatchJob *job) {
+  int pipefd[2];
+  int ret = pipe(pipefd);
+  Assert(ret == 0, "Can not create pipe for the worker");
+
+  // buffered output must not be flushed twice by the worker
+  fflush(stdout);
+  fflush(stderr);
+
+  job->start = get_time();
+  job->pid = fork();
+  Assert(job->pid >= 0, "Can not fork the worker");
+  if (job->pid == 0) {
+    close(pipefd[0]);
+    worker_main(job, pipefd[1]);
+  }
+  close(pipefd[1]);
+  job->fd = pipefd[0];
+}
+
+static BatchJob* reap() {
+  int status;
+  pid_t pid = wait(&status);
+  Assert(pid > 0, "Can not wait for the workers");
+
+  int i;
+  for (i = 0; i < nr_job && jobs[i].pid != pid; i ++);
+  assert(i < nr_job);
+  BatchJob *job = &jobs[i];
+
+  job->wall_time = get_time() - job->start;
+  job->finished = (read(job->fd, &job->res, sizeof(job->res)) == sizeof(job->res));
+  job->signum = (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+  close(job->fd);
+  job->fd = -1;
+  return job;
+}
+
+static bool job_is_good(BatchJob *job) {
+  return job->finished && job->res.state == NEMU_END && job->res.halt_ret == 0;
+}
+
+static const char* job_result(BatchJob *job) {
+  if (!job->finished) return ANSI_FMT("CRASH        ", ANSI_FG_RED);
+  switch (job->res.state) {
+    case NEMU_END: return (job->res.halt_ret == 0 ?
+                       ANSI_FMT("HIT GOOD TRAP", ANSI_FG_GREEN) : ANSI_FMT("HIT BAD TRAP ", ANSI_FG_RED));
+    case NEMU_ABORT: return ANSI_FMT("ABORT        ", ANSI_FG_RED);
+    case NEMU_QUIT: return ANSI_FMT("QUIT         ", ANSI_FG_YELLOW);
+    default: return ANSI_FMT("STOP         ", ANSI_FG_YELLOW);
+  }
+}
+
+static void report(int nr_worker, uint64_t wall_time) {
+  uint64_t total_inst = 0;
+  int nr_good = 0;
+
+  printf("\n%-13s  %20s  %15s  %12s  %s\n", "result", "guest inst", "inst/s", "time (us)", "image");
+  for (int i = 0; i < nr_job; i ++) {
+    BatchJob *job = &jobs[i];
+    const char *img = job->argv[job->argc - 1];
+    if (!job->finished) {
+      printf("%s  %20s  %15s  %12" PRIu64 "  %s (signal %d)\n", job_result(job), "-", "-",
+          job->wall_time, img, job->signum);
+      continue;
+    }
+    uint64_t freq = (job->res.exec_time > 0 ? job->res.nr_inst * 1000000 / job->res.exec_time : 0);
+    printf("%s  %20" PRIu64 "  %15" PRIu64 "  %12" PRIu64 "  %s\n", job_result(job),
+        job->res.nr_inst, freq, job->wall_time, img);
+    total_inst += job->res.nr_inst;
+    if (job_is_good(job)) nr_good ++;
+  }
+  printf("\n");
+
+  Log("batch: %d/%d images hit good trap with %d workers", nr_good, nr_job, nr_worker);
+  Log("batch: total guest instructions = %" PRIu64 ", wall time = %" PRIu64 " us", total_inst, wall_time);
+  if (wall_time > 0) Log("batch: aggregate simulation frequency = %" PRIu64 " inst/s", total_inst * 1000000 / wall_time);
+
+  // let the exit status of NEMU reflect the whole batch
+  nemu_state.state = NEMU_END;
+  nemu_state.halt_ret = nr_job - nr_good;
+}
+
+/* Return false if there is no manifest to run. */
+bool batch_mainloop() {
+  if (nr_job == 0) return false;
+
+  int nr_worker = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nr_worker < 1) nr_worker = 1;
+  if (nr_worker > nr_job) nr_worker = nr_job;
+  Log("batch: running %d images with %d workers", nr_job, nr_worker);
+
+  uint64_t start = get_time();
+  int next = 0, nr_running = 0, nr_done = 0;
+  while (nr_done < nr_job) {
+    while (nr_running < nr_worker && next < nr_job) {
+      spawn(&jobs[next ++]);
+      nr_running ++;
+    }
+    BatchJob *job = reap();
+    nr_running --;
+    nr_done ++;
+    if (!job_is_good(job)) {
+      Log("batch: %s finished with %s", job->argv[job->argc - 1], job_result(job));
+    }
+  }
+
+  report(nr_worker, get_time() - start);
+  return true;
+}
+#endif
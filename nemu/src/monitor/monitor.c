@@ -40,10 +40,12 @@ static void welcome() {
 #include <getopt.h>
 
 void sdb_set_batch_mode();
+void init_batch(const char *manifest);
 
 static char *log_file = NULL;
 static char *diff_so_file = NULL;
 static char *img_file = NULL;
+static char *manifest_file = NULL;
 static int difftest_port = 1234;
 
 static long load_img() {
@@ -74,16 +76,18 @@ static int parse_args(int argc, char *argv[]) {
     {"log"      , required_argument, NULL, 'l'},
     {"diff"     , required_argument, NULL, 'd'},
     {"port"     , required_argument, NULL, 'p'},
+    {"manifest" , required_argument, NULL, 'm'},
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
   int o;
-  while ( (o = getopt_long(argc, argv, "-bhl:d:p:", table, NULL)) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bhl:d:p:m:", table, NULL)) != -1) {
     switch (o) {
       case 'b': sdb_set_batch_mode(); break;
       case 'p': sscanf(optarg, "%d", &difftest_port); break;
       case 'l': log_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
+      case 'm': manifest_file = optarg; break;
       case 1: img_file = optarg; return 0;
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
@@ -91,6 +95,7 @@ static int parse_args(int argc, char *argv[]) {
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
+        printf("\t-m,--manifest=FILE      run all images listed in FILE with a pool of workers\n");
         printf("\n");
         exit(0);
     }
@@ -113,12 +118,23 @@ void init_monitor(int argc, char *argv[]) {
   /* Initialize memory. */
   init_mem();
 
-  /* Initialize devices. */
-  IFDEF(CONFIG_DEVICE, init_device());
+  /* Initialize devices. The threads of the devices are not inherited
+   * by fork(), so the batch workers initialize their own devices. */
+  if (manifest_file == NULL) {
+    IFDEF(CONFIG_DEVICE, init_device());
+  }
 
   /* Perform ISA dependent initialization. */
   init_isa();
 
+  if (manifest_file != NULL) {
+    /* Images are loaded by the workers. Everything initialized
+     * so far is shared with them by fork(). */
+    IFDEF(CONFIG_ITRACE, init_disasm());
+    init_batch(manifest_file);
+    return;
+  }
+
   /* Load the image to memory. This will overwrite the built-in image. */
   long img_size = load_img();
 
@@ -133,6 +149,24 @@ void init_monitor(int argc, char *argv[]) {
   /* Display welcome message. */
   welcome();
 }
+
+/* Called in a forked worker of the batch runner with the
+ * arguments of one manifest entry. */
+void init_batch_worker(int argc, char *argv[]) {
+  log_file = NULL;
+  diff_so_file = NULL;
+  img_file = NULL;
+  optind = 0;
+  parse_args(argc, argv);
+  Assert(img_file != NULL, "No image is given in the manifest entry");
+
+  init_log(log_file);
+
+  IFDEF(CONFIG_DEVICE, init_device());
+
+  long img_size = load_img();
+  init_difftest(diff_so_file, img_size, difftest_port);
+}
 #else // CONFIG_TARGET_AM
 static long load_img() {
   extern char bin_start, bin_end;
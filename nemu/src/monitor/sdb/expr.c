@@ -252,7 +252,9 @@ word_t eval(int p, int q, bool *success) {
 				if (val2 < CONFIG_MBASE || val2 > 0x87ffffff) {
 				return 0;
 			} else {
-				return vaddr_read(val2, 8);
+				word_t data = vaddr_read(val2, 8);
+				isa_mmu_discard_fault(); // a probe must not fault the guest
+				return data;
 				}
 			}
 			return val1 * val2;
@@ -113,6 +113,7 @@ static int cmd_x(char *args) {
 					if (i % 5 == 0)
 						printf("\n");
 					word_t data = vaddr_read(addr + i * 4 + CONFIG_MBASE, 4);
+					isa_mmu_discard_fault(); // a probe must not fault the guest
 					printf("\033[33m0x%08lx\033[0m\t", data);
 				}
 			}
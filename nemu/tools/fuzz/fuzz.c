@@ -0,0 +1,213 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// Fuzz a guest program with AFL, or run it on some inputs.
+//
+// The image is loaded and a snapshot is taken. Every input is run on a
+// machine restored from the snapshot, so no process is forked. The input
+// is read by the guest from the RX register of the serial port, or from
+// guest memory as a 32-bit length followed by the data with `-m'.
+//
+// The guest fails if it executes an invalid instruction, accesses
+// unmapped memory or halts with a non-zero code. It is reported to AFL
+// as killed by SIGABRT.
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/shm.h>
+#include <libnemu.h>
+
+#define FORKSRV_FD 198
+#define MAP_SIZE (1 << 16)
+#define MAX_INPUT (1 << 20)
+
+// registers of the serial port, compatible with 16550
+#define UART_DATA 0
+#define UART_LSR  5
+#define UART_SIZE 8
+#define LSR_RX_READY 0x01
+#define LSR_TX_IDLE  0x60
+
+static uint64_t serial_base = 0xa00003f8;
+static uint64_t input_addr = 0;
+static uint64_t nr_inst = 10000000;
+static char *img_file = NULL;
+
+static uint8_t input[MAX_INPUT];
+static size_t input_len = 0, input_pos = 0;
+static bool afl = false;
+
+static uint64_t serial_read(void *opaque, uint64_t offset, int len) {
+  switch (offset) {
+    case UART_DATA: return (input_addr == 0 && input_pos < input_len ? input[input_pos ++] : 0xff);
+    case UART_LSR: return LSR_TX_IDLE | (input_addr == 0 && input_pos < input_len ? LSR_RX_READY : 0);
+    default: return 0;
+  }
+}
+
+static void serial_write(void *opaque, uint64_t offset, int len, uint64_t data) {
+  if (offset == UART_DATA && !afl) putchar(data);
+}
+
+static void read_input(int fd) {
+  ssize_t n;
+  input_len = 0;
+  while (input_len < sizeof(input) && (n = read(fd, input + input_len, sizeof(input) - input_len)) > 0) {
+    input_len += n;
+  }
+}
+
+static void read_input_file(const char *file) {
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) { perror(file); exit(1); }
+  read_input(fd);
+  close(fd);
+}
+
+static void load_img(NEMUMachine *m) {
+  FILE *fp = fopen(img_file, "rb");
+  if (fp == NULL) { perror(img_file); exit(1); }
+  static uint8_t img[1 << 24];
+  size_t size = fread(img, 1, sizeof(img), fp);
+  fclose(fp);
+  if (nemu_load_image(m, img, size) != 0) {
+    fprintf(stderr, "%s is too large\n", img_file);
+    exit(1);
+  }
+}
+
+// return true if the guest fails
+static bool run_one(NEMUMachine *m, NEMUSnapshot *snap) {
+  nemu_restore(m, snap);
+  input_pos = 0;
+  if (input_addr != 0) {
+    uint32_t len = input_len;
+    if (nemu_mem_write(m, input_addr, &len, sizeof(len)) != 0 ||
+        nemu_mem_write(m, input_addr + sizeof(len), input, input_len) != 0) {
+      fprintf(stderr, "input does not fit in memory at 0x%" PRIx64 "\n", input_addr);
+      exit(1);
+    }
+  }
+  switch (nemu_run(m, nr_inst)) {
+    case NEMU_EVENT_TRAP: return nemu_trap_code(m) != 0;
+    case NEMU_EVENT_ABORT: return true;
+    default: return false; // out of budget
+  }
+}
+
+// Talk to AFL with the protocol of its fork server, but report our own
+// pid instead of forking. Keep the instruction budget within the timeout
+// of AFL, since it kills the reported pid on timeout.
+static void afl_loop(NEMUMachine *m, NEMUSnapshot *snap, const char *file) {
+  int32_t msg = 0;
+  if (write(FORKSRV_FD + 1, &msg, 4) != 4) {
+    fprintf(stderr, "not started by AFL\n");
+    exit(1);
+  }
+  while (read(FORKSRV_FD, &msg, 4) == 4) {
+    if (file != NULL) read_input_file(file);
+    else {
+      // AFL rewinds the input file behind stdin before every run
+      lseek(0, 0, SEEK_SET);
+      read_input(0);
+    }
+    int32_t pid = getpid();
+    if (write(FORKSRV_FD + 1, &pid, 4) != 4) exit(1);
+    int32_t status = (run_one(m, snap) ? SIGABRT : 0);
+    if (write(FORKSRV_FD + 1, &status, 4) != 4) exit(1);
+  }
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [OPTION...] IMAGE [INPUT...]\n\n", name);
+  printf("\t-m,--memory=ADDR        put the input in guest memory at ADDR instead of serial RX\n");
+  printf("\t-s,--serial=ADDR        base of the serial port (default: 0x%" PRIx64 ")\n", serial_base);
+  printf("\t-n,--inst=N             execute at most N instructions per input (default: %" PRIu64 ")\n", nr_inst);
+  printf("\nRun each INPUT once, or fuzz with AFL if __AFL_SHM_ID is set.\n");
+  printf("Under AFL, INPUT is the file given by @@, otherwise the input is read from stdin.\n");
+}
+
+int main(int argc, char *argv[]) {
+  const struct option table[] = {
+    {"memory", required_argument, NULL, 'm'},
+    {"serial", required_argument, NULL, 's'},
+    {"inst"  , required_argument, NULL, 'n'},
+    {"help"  , no_argument      , NULL, 'h'},
+    {0       , 0                , NULL,  0 },
+  };
+  int o;
+  while ( (o = getopt_long(argc, argv, "m:s:n:h", table, NULL)) != -1) {
+    switch (o) {
+      case 'm': input_addr = strtoull(optarg, NULL, 0); break;
+      case 's': serial_base = strtoull(optarg, NULL, 0); break;
+      case 'n': nr_inst = strtoull(optarg, NULL, 0); break;
+      default: usage(argv[0]); return (o == 'h' ? 0 : 1);
+    }
+  }
+  if (optind >= argc) { usage(argv[0]); return 1; }
+  img_file = argv[optind ++];
+
+  NEMUMachine *m = nemu_create();
+  if (m == NULL) { fprintf(stderr, "failed to create the machine\n"); return 1; }
+  if (nemu_add_mmio(m, serial_base, UART_SIZE, serial_read, serial_write, NULL) != 0) {
+    fprintf(stderr, "failed to map the serial port at 0x%" PRIx64 "\n", serial_base);
+    return 1;
+  }
+  load_img(m);
+  NEMUSnapshot *snap = nemu_snapshot(m);
+  if (snap == NULL) { fprintf(stderr, "failed to take the snapshot\n"); return 1; }
+
+  char *shm_id = getenv("__AFL_SHM_ID");
+  if (shm_id != NULL) {
+    afl = true;
+    char *map_size = getenv("AFL_MAP_SIZE");
+    size_t size = (map_size ? strtoul(map_size, NULL, 0) : MAP_SIZE);
+    uint8_t *map = shmat(atoi(shm_id), NULL, 0);
+    if (map == (void *)-1 || nemu_set_coverage(m, map, size) != 0) {
+      fprintf(stderr, "failed to set up the coverage map, "
+          "is NEMU built with CONFIG_FUZZ_COVERAGE?\n");
+      return 1;
+    }
+    afl_loop(m, snap, (optind < argc ? argv[optind] : NULL));
+    return 0;
+  }
+
+  static uint8_t map[MAP_SIZE];
+  bool has_cov = (nemu_set_coverage(m, map, MAP_SIZE) == 0);
+  int nr_fail = 0;
+  for (; optind < argc; optind ++) {
+    read_input_file(argv[optind]);
+    memset(map, 0, sizeof(map));
+    bool fail = run_one(m, snap);
+    nr_fail += fail;
+    int nr_edge = 0;
+    for (int i = 0; i < MAP_SIZE; i ++) nr_edge += (map[i] != 0);
+    printf("\n%s: %s, %" PRIu64 " inst", argv[optind], (fail ? "FAIL" : "ok"), nemu_inst_count(m));
+    if (has_cov) printf(", %d edges", nr_edge);
+    printf("\n");
+  }
+
+  nemu_snapshot_free(snap);
+  nemu_destroy(m);
+  return (nr_fail != 0);
+}